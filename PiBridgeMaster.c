@@ -92,6 +92,9 @@ void PiBridgeMaster_Reset(void)
 	init_retry = MAX_INIT_RETRIES;
 
 	RevPiDevice_init();
+	// the configuration was reloaded, do not apply the safe state of the old
+	// one until the initialization rebuilds it for the active modules
+	revpi_safe_state_build();
 	rt_mutex_unlock(&piCore_g.lockBridgeState);
 }
 
@@ -155,6 +158,7 @@ int PiBridgeMaster_Adjust(void)
 				RevPiDevice_getDev(j)->i16uOutputOffset = piDev_g.devs->dev[i].i16uOutputOffset;
 				RevPiDevice_getDev(j)->i16uConfigOffset = piDev_g.devs->dev[i].i16uConfigOffset;
 				RevPiDevice_getDev(j)->i16uConfigLength = piDev_g.devs->dev[i].i16uConfigLength;
+				RevPiDevice_getDev(j)->i8uPollDivisor = piDev_g.devs->dev[i].i8uPollDivisor;
 				if (j == 0) {
 					RevPiDevice_setCoreOffset(RevPiDevice_getDev(0)->i16uInputOffset);
 				}
@@ -194,6 +198,7 @@ int PiBridgeMaster_Adjust(void)
 			RevPiDevice_getDev(j)->i16uOutputOffset = piDev_g.devs->dev[i].i16uOutputOffset;
 			RevPiDevice_getDev(j)->i16uConfigOffset = piDev_g.devs->dev[i].i16uConfigOffset;
 			RevPiDevice_getDev(j)->i16uConfigLength = piDev_g.devs->dev[i].i16uConfigLength;
+			RevPiDevice_getDev(j)->i8uPollDivisor = piDev_g.devs->dev[i].i8uPollDivisor;
 			RevPiDevice_getDev(j)->sId.i32uSerialnumber = piDev_g.devs->dev[i].i32uSerialnumber;
 			RevPiDevice_getDev(j)->sId.i16uHW_Revision = piDev_g.devs->dev[i].i16uHW_Revision;
 			RevPiDevice_getDev(j)->sId.i16uSW_Major = piDev_g.devs->dev[i].i16uSW_Major;
@@ -206,6 +211,8 @@ int PiBridgeMaster_Adjust(void)
 		}
 	}
 
+	RevPiDevice_schedule();
+
 	kfree(state);
 	return result;
 }
@@ -583,9 +590,9 @@ int PiBridgeMaster_Run(void)
 				PiBridgeMaster_setDefaults();
 
 #ifndef ENDTEST_DIO
-				my_rt_mutex_lock(&piDev_g.lockPI);
+				revpi_image_write_lock();
 				memcpy(piDev_g.ai8uPI, piDev_g.ai8uPIDefault, KB_PI_LEN);
-				rt_mutex_unlock(&piDev_g.lockPI);
+				revpi_image_write_unlock();
 #else
 #warning Defaultvalues are NOT set in process image
 #endif
@@ -640,6 +647,8 @@ int PiBridgeMaster_Run(void)
 						}
 					}
 				}
+				// modules which failed to initialize are inactive now
+				revpi_safe_state_build();
 				bEntering_s = bFALSE;
 				ret = 0;
 			}
@@ -863,10 +872,10 @@ int PiBridgeMaster_Run(void)
 			p2 = (INT8U *)&piCore_g.image;
 			pI1 = (SRevPiCoreImage *)p1;
 			pI2 = (SRevPiCoreImage *)p2;
-			my_rt_mutex_lock(&piDev_g.lockPI);
+			revpi_image_write_lock();
 			pI1->drv = pI2->drv;
 			pI2->usr = pI1->usr;
-			rt_mutex_unlock(&piDev_g.lockPI);
+			revpi_image_write_unlock();
 		}
 	}
 
@@ -32,6 +32,7 @@
 
 #include <linux/module.h>	// included for all kernel modules
 #include <linux/delay.h>
+#include <linux/gcd.h>
 
 #include <project.h>
 
@@ -107,6 +108,8 @@ void RevPiDevice_init(void)
 	RevPiDevices_s.i8uAddressLeft = REV_PI_DEV_FIRST_RIGHT - 1;	// first address of a left side module
 	RevPiDevice_resetDevCnt();	// counter for detected devices
 	RevPiDevices_s.i16uErrorCnt = 0;
+	RevPiDevice_resetStats();
+	memset(RevPiDevices_s.timing, 0, sizeof(RevPiDevices_s.timing));
 
 	// RevPi as first entry to device list
 	RevPiDevice_getDev(RevPiDevice_getDevCnt())->i8uAddress = 0;
@@ -164,6 +167,173 @@ void revpi_dev_update_state(INT8U i8uDevice, INT32U r, int *retval)
 	}
 }
 
+#define REV_PI_RTO_MIN_US		2000	// lower limit of the adaptive receive timeout
+#define REV_PI_RTO_GRANULARITY_US	500	// least margin above srtt, plus the response on the wire
+#define REV_PI_RTO_MAX_US		(REV_PI_IO_TIMEOUT * USEC_PER_MSEC)
+#define REV_PI_BACKOFF_TIMEOUTS		3	// consecutive timeouts until a module is skipped
+#define REV_PI_BACKOFF_MAX_SHIFT	6	// skip a module for at most 64 cycles
+
+static bool backoff;
+module_param(backoff, bool, 0444);
+MODULE_PARM_DESC(backoff, "skip input-only modules which repeatedly do not answer for up to 64 cycles (default: false)");
+
+//-------------------------------------------------------------------------------------------------
+// Adapt the receive timeout of a module to its round trip time like TCP does
+// (RFC 6298): timeout = srtt + max(G, 4 * rttvar), limited to REV_PI_RTO_MIN_US
+// and REV_PI_RTO_MAX_US. G is REV_PI_RTO_GRANULARITY_US plus the time the
+// response of the module needs on the wire. A timeout doubles the receive
+// timeout. If the module parameter backoff is set, a module without outputs
+// is skipped for 1, 2, 4, ... cycles after REV_PI_BACKOFF_TIMEOUTS consecutive
+// timeouts until it answers again, so a missing module does not cost a full
+// timeout in every cycle. Modules with outputs are never skipped, their outputs must be sent.
+//-------------------------------------------------------------------------------------------------
+static void revpi_dev_update_timing(INT8U i8uDevice, INT32U r, u32 rtt)
+{
+	SDeviceTiming *timing = RevPiDevice_getTiming(i8uDevice);
+	SDevice *dev = RevPiDevice_getDev(i8uDevice);
+	u32 delta, margin;
+
+	if (r == 0) {
+		if (timing->i32uSrtt == 0) {
+			timing->i32uSrtt = rtt;
+			timing->i32uRttVar = rtt / 2;
+		} else {
+			delta = abs((s32)(timing->i32uSrtt - rtt));
+			timing->i32uRttVar = (3 * timing->i32uRttVar + delta) / 4;
+			timing->i32uSrtt = (7 * timing->i32uSrtt + rtt) / 8;
+		}
+		// rttvar decays to 0 for a steady module, keep a margin for jitter
+		margin = REV_PI_RTO_GRANULARITY_US +
+			 piIoComm_onWireUs(dev->sId.i16uFBS_InputLength + sizeof(UIoProtocolHeader) + 1);
+		timing->i32uRto = clamp_t(u32, timing->i32uSrtt + max_t(u32, margin, 4 * timing->i32uRttVar),
+					  REV_PI_RTO_MIN_US, REV_PI_RTO_MAX_US);
+		timing->i8uTimeouts = 0;
+	} else if (r == 2) {
+		if (timing->i32uRto)
+			timing->i32uRto = min_t(u32, 2 * timing->i32uRto, REV_PI_RTO_MAX_US);
+		if (timing->i8uTimeouts < 255)
+			timing->i8uTimeouts++;
+		if (backoff && timing->i8uTimeouts >= REV_PI_BACKOFF_TIMEOUTS
+		    && dev->sId.i16uFBS_OutputLength == 0)
+			timing->i8uSkip = 1 << min(timing->i8uTimeouts - REV_PI_BACKOFF_TIMEOUTS,
+						   REV_PI_BACKOFF_MAX_SHIFT);
+	}
+}
+
+// map the error of revpi_io_talk based telegrams to the result of
+// piDIOComm_sendCyclicTelegram
+static INT32U revpi_dev_errno_to_result(int ret)
+{
+	switch (ret) {
+	case 0:
+		return 0;
+	case -EBADMSG:
+		return 1;	// wrong crc
+	case -ETIMEDOUT:
+		return 2;	// no response
+	case -ECOMM:
+		return 3;	// could not send
+	default:
+		return 4;
+	}
+}
+
+// classify the result of a cyclic telegram, see piDIOComm_sendCyclicTelegram
+static void revpi_dev_update_stats(INT8U i8uDevice, INT32U r, ktime_t start)
+{
+	SDeviceStats *stats = RevPiDevice_getStats(i8uDevice);
+	u32 rtt = ktime_us_delta(ktime_get(), start);
+
+	revpi_dev_update_timing(i8uDevice, r, rtt);
+
+	switch (r) {
+	case 0:
+		revpi_stat_add(&stats->rtt, rtt);
+		break;
+	case 1:
+		stats->i32uCrcErrors++;
+		break;
+	case 2:
+		stats->i32uTimeouts++;
+		break;
+	case 3:
+		stats->i32uSendErrors++;
+		break;
+	default:
+		stats->i32uOtherErrors++;
+		break;
+	}
+}
+
+// the divisor may be changed by KB_SET_POLL_DIVISOR at any time
+static unsigned int revpi_dev_poll_divisor(SDevice *dev)
+{
+	unsigned int div = READ_ONCE(dev->i8uPollDivisor);
+
+	return div ? div : 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Distribute the modules with a poll divisor > 1 over the cycles. The phase of
+// each module is chosen so that it collides as rarely as possible with the
+// modules placed before it. Two modules with the divisors a and b and the
+// phases pa and pb get a telegram in the same cycle if pa and pb are equal
+// modulo gcd(a, b), which happens in gcd(a, b) out of a * b cycles.
+// Modules which are polled every cycle load all cycles equally and are ignored.
+//-------------------------------------------------------------------------------------------------
+void RevPiDevice_schedule(void)
+{
+	int i, j;
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		SDevice *dev = RevPiDevice_getDev(i);
+		unsigned int div = revpi_dev_poll_divisor(dev);
+		unsigned int p, best = 0, cost, best_cost = UINT_MAX;
+
+		for (p = 0; p < div && div > 1; p++) {
+			cost = 0;
+			for (j = 0; j < i; j++) {
+				SDevice *other = RevPiDevice_getDev(j);
+				unsigned int odiv = revpi_dev_poll_divisor(other);
+				unsigned int g;
+
+				if (odiv == 1 || !other->i8uActive)
+					continue;
+				g = gcd(div, odiv);
+				if (p % g == other->i8uPollPhase % g)
+					cost += (g << 16) / (div * odiv);
+			}
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = p;
+			}
+		}
+		dev->i8uPollPhase = best;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Set the poll divisor of the module with the given address. The phases are
+// recomputed by the piIO thread before the next cycle.
+//-------------------------------------------------------------------------------------------------
+int RevPiDevice_setPollDivisor(INT8U i8uAddress, INT8U i8uDivisor)
+{
+	int i;
+
+	if (i8uDivisor == 0 || i8uDivisor > PICONTROL_POLL_DIVISOR_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		if (RevPiDevice_getDev(i)->i8uAddress == i8uAddress) {
+			WRITE_ONCE(RevPiDevice_getDev(i)->i8uPollDivisor, i8uDivisor);
+			// the I/O thread must see the divisor when it reschedules
+			smp_store_release(&RevPiDevices_s.bReschedule, true);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
 //*************************************************************************************************
 //| Function: RevPiDevice_run
 //|
@@ -180,25 +350,52 @@ int RevPiDevice_run(void)
 	INT8U i8uDevice = 0;
 	INT32U r;
 	int retval = 0;
+	ktime_t start;
 
 	RevPiDevices_s.i16uErrorCnt = 0;
 
+	if (smp_load_acquire(&RevPiDevices_s.bReschedule)) {
+		WRITE_ONCE(RevPiDevices_s.bReschedule, false);
+		RevPiDevice_schedule();
+	}
+
 	for (i8uDevice = 0; i8uDevice < RevPiDevice_getDevCnt(); i8uDevice++) {
+		SDevice *dev = RevPiDevice_getDev(i8uDevice);
+
+		// skip the modules which are not due in this cycle
+		if (RevPiDevices_s.i32uCycle % revpi_dev_poll_divisor(dev) != dev->i8uPollPhase)
+			continue;
+
+		// skip the modules which did not answer recently, see revpi_dev_update_timing()
+		// the skipped poll counts as a failed one for the error counters and the module state
+		if (RevPiDevices_s.timing[i8uDevice].i8uSkip) {
+			RevPiDevices_s.timing[i8uDevice].i8uSkip--;
+			revpi_dev_update_state(i8uDevice, 2, &retval);
+			continue;
+		}
+		piIoComm_setRecvTimeout(RevPiDevices_s.timing[i8uDevice].i32uRto);
+
 		if (RevPiDevice_getDev(i8uDevice)->i8uActive) {
 			switch (RevPiDevice_getDev(i8uDevice)->sId.i16uModulType) {
 			case KUNBUS_FW_DESCR_TYP_PI_DIO_14:
 			case KUNBUS_FW_DESCR_TYP_PI_DI_16:
 			case KUNBUS_FW_DESCR_TYP_PI_DO_16:
+				start = ktime_get();
 				r = piDIOComm_sendCyclicTelegram(i8uDevice);
+				revpi_dev_update_stats(i8uDevice, r, start);
 				revpi_dev_update_state(i8uDevice, r, &retval);
 				break;
 
 			case KUNBUS_FW_DESCR_TYP_PI_AIO:
+				start = ktime_get();
 				r = piAIOComm_sendCyclicTelegram(i8uDevice);
+				revpi_dev_update_stats(i8uDevice, r, start);
 				revpi_dev_update_state(i8uDevice, r, &retval);
 				break;
 			case KUNBUS_FW_DESCR_TYP_PI_MIO:
-				r = revpi_mio_cycle(i8uDevice);
+				start = ktime_get();
+				r = revpi_dev_errno_to_result(revpi_mio_cycle(i8uDevice));
+				revpi_dev_update_stats(i8uDevice, r, start);
 				revpi_dev_update_state(i8uDevice, r, &retval);
 				break;
 
@@ -237,6 +434,8 @@ int RevPiDevice_run(void)
 		}
 	}
 
+	piIoComm_setRecvTimeout(0);
+
 	// if the user-ioctl want to send a telegram, do it now
 	if (piCore_g.pendingUserTel == true) {
 		piCore_g.statusUserTel = piIoComm_sendTelegram(&piCore_g.requestUserTel, &piCore_g.responseUserTel);
@@ -244,6 +443,7 @@ int RevPiDevice_run(void)
 		up(&piCore_g.semUserTel);
 	}
 
+	RevPiDevices_s.i32uCycle++;
 	return retval;
 }
 
@@ -439,6 +639,32 @@ SDevice *RevPiDevice_getDev(INT8U idx)
 		return &RevPiDevices_s.dev[0];
 }
 
+SDeviceTiming *RevPiDevice_getTiming(INT8U idx)
+{
+	if (idx <= RevPiDevices_s.i8uDeviceCount)
+		return &RevPiDevices_s.timing[idx];
+	else
+		return &RevPiDevices_s.timing[0];
+}
+
+SDeviceStats *RevPiDevice_getStats(INT8U idx)
+{
+	if (idx <= RevPiDevices_s.i8uDeviceCount)
+		return &RevPiDevices_s.stats[idx];
+	else
+		return &RevPiDevices_s.stats[0];
+}
+
+void RevPiDevice_resetStats(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(RevPiDevices_s.stats); i++) {
+		memset(&RevPiDevices_s.stats[i], 0, sizeof(SDeviceStats));
+		revpi_stat_reset(&RevPiDevices_s.stats[i].rtt);
+	}
+}
+
 void RevPiDevice_resetDevCnt(void)
 {
 	RevPiDevices_s.i8uDeviceCount = 0;
@@ -34,6 +34,7 @@
 
 #include <ModGateComMain.h>
 #include <piIOComm.h>
+#include "revpi_stats.h"
 
 typedef struct _SRevPiCoreImage SRevPiCoreImage;
 
@@ -54,8 +55,28 @@ typedef struct _SDevice
     MODGATECOM_IDResp sId;
     INT8U i8uModuleState;
 	INT8U i8uPriv;	//used by the module privately
+    INT8U i8uPollDivisor;	// the module gets a cyclic telegram every i8uPollDivisor cycles, 0 is the same as 1
+    INT8U i8uPollPhase;		// ... in the cycles where cycle % i8uPollDivisor == i8uPollPhase
 } SDevice;
 
+typedef struct _SDeviceStats
+{
+    struct revpi_stat rtt;	// round trip time of the answered cyclic telegrams
+    INT32U i32uCrcErrors;	// invalid response
+    INT32U i32uTimeouts;	// no response
+    INT32U i32uSendErrors;	// telegram could not be sent
+    INT32U i32uOtherErrors;
+} SDeviceStats;
+
+typedef struct _SDeviceTiming
+{
+    INT32U i32uSrtt;		// smoothed round trip time in us, 0 if not measured yet
+    INT32U i32uRttVar;		// mean deviation of the round trip time in us
+    INT32U i32uRto;		// receive timeout in us, 0 for REV_PI_IO_TIMEOUT
+    INT8U i8uTimeouts;		// consecutive timeouts
+    INT8U i8uSkip;		// number of cycles the module is still skipped
+} SDeviceTiming;
+
 
 typedef struct _SDeviceConfig
 {
@@ -67,6 +88,10 @@ typedef struct _SDeviceConfig
     INT8U  i8uStatus;               // status bitfield of RevPi
     unsigned int offset;		// Offset in RevPi in process image
     SDevice dev[REV_PI_DEV_CNT_MAX+1];
+    SDeviceStats stats[REV_PI_DEV_CNT_MAX+1];
+    SDeviceTiming timing[REV_PI_DEV_CNT_MAX+1];
+    INT32U i32uCycle;		// number of calls of RevPiDevice_run
+    bool bReschedule;		// the poll divisors were changed, recompute the phases
 } SDeviceConfig;
 
 //-------------------------------------------------------------------------------------------------
@@ -95,6 +120,11 @@ INT8U RevPiDevice_getAddrRight(void);
 
 INT16U RevPiDevice_getErrCnt(void);
 SDevice *RevPiDevice_getDev(INT8U idx);
+SDeviceStats *RevPiDevice_getStats(INT8U idx);
+SDeviceTiming *RevPiDevice_getTiming(INT8U idx);
+void RevPiDevice_resetStats(void);
+int RevPiDevice_setPollDivisor(INT8U i8uAddress, INT8U i8uDivisor);
+void RevPiDevice_schedule(void);
 
 void RevPiDevice_setCoreOffset(unsigned int offset);
 unsigned int RevPiDevice_getCoreOffset(void);
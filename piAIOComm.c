@@ -370,9 +370,7 @@ INT32U piAIOComm_sendCyclicTelegram(INT8U i8uDevice_p)
 	i8uAddress = RevPiDevice_getDev(i8uDevice_p)->i8uAddress;
 
 	if (piDev_g.stopIO == false) {
-		my_rt_mutex_lock(&piDev_g.lockPI);
-		memcpy(data_out, piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uOutputOffset, len_l);
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_read(data_out, piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uOutputOffset, len_l);
 	} else {
 		memset(data_out, 0, len_l);
 	}
@@ -406,10 +404,10 @@ INT32U piAIOComm_sendCyclicTelegram(INT8U i8uDevice_p)
 				memcpy(data_in, sResponse_l.ai8uData, len_l);
 
 				if (piDev_g.stopIO == false) {
-					my_rt_mutex_lock(&piDev_g.lockPI);
+					revpi_image_write_lock();
 					memcpy(piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uInputOffset, data_in,
 					       sizeof(data_in));
-					rt_mutex_unlock(&piDev_g.lockPI);
+					revpi_image_write_unlock();
 				}
 
 #ifdef DEBUG_DEVICE_AIO
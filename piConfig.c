@@ -37,6 +37,9 @@
 #include <linux/kernel.h>	// included for KERN_INFO
 #include <linux/slab.h>		// included for KERN_INFO
 #include <linux/fs.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/sort.h>
 #include <asm/uaccess.h>
 #include <asm/segment.h>
 
@@ -59,6 +62,7 @@
 #define TOKEN_MEMORY        "mem"
 #define TOKEN_CONFIG        "config"
 #define TOKEN_OFFSET        "offset"
+#define TOKEN_POLL_DIVISOR  "pollDivisor"
 #define TOKEN_SRC_GUID      "srcGUID"
 #define TOKEN_SRC_NAME      "srcAttrname"
 #define TOKEN_DEST_GUID     "destGUID"
@@ -522,6 +526,10 @@ static piDevices *find_devices(json_val_t * element, SDeviceInfo * pDev, int lvl
 					} else if (strcmp(element->u.object[i]->key, TOKEN_OFFSET) == 0) {
 						if (kstrtou16(element->u.object[i]->val->u.data, 0, &pDev->i16uBaseOffset) != 0)
 							pDev->i16uBaseOffset = 0;
+					} else if (strcmp(element->u.object[i]->key, TOKEN_POLL_DIVISOR) == 0) {
+						if (kstrtou8(element->u.object[i]->val->u.data, 0, &pDev->i8uPollDivisor) != 0
+						    || pDev->i8uPollDivisor > PICONTROL_POLL_DIVISOR_MAX)
+							pDev->i8uPollDivisor = 0;
 					} else if (strcmp(element->u.object[i]->key, TOKEN_INPUT) == 0) {
 						ret = find_devices(element->u.object[i]->val, pDev, 200);
 					} else if (strcmp(element->u.object[i]->key, TOKEN_OUTPUT) == 0) {
@@ -687,16 +695,109 @@ static void find_entries(json_val_t * element, piEntries * pEnt, int *pIdxEntry,
 	}
 }
 
-static SEntryInfo *search_entry(piEntries * ent, char *strName)
+#define ENTRY_HASH_END	0xffff
+
+static u32 entry_hash(const char *strName)
+{
+	return jhash(strName, strlen(strName), 0);
+}
+
+static void build_entry_hash(piEntries * ent)
 {
+	uint16_t *head = ent->pi16uHash;
+	uint16_t *next = head + ent->i16uHashMask + 1;
 	int i;
-	for (i = 0; i < ent->i16uNumEntries; i++) {
+
+	memset(head, 0xff, (ent->i16uHashMask + 1) * sizeof(*head));
+
+	// insert backwards, so that the entries of a bucket are in ascending
+	// order and the first of several entries with the same name is found
+	for (i = ent->i16uNumEntries - 1; i >= 0; i--) {
+		u32 h = entry_hash(ent->ent[i].strVarName) & ent->i16uHashMask;
+
+		next[i] = head[h];
+		head[h] = i;
+	}
+}
+
+SEntryInfo *piConfigFindEntry(piEntries * ent, const char *strName)
+{
+	uint16_t *next = ent->pi16uHash + ent->i16uHashMask + 1;
+	uint16_t i;
+
+	i = ent->pi16uHash[entry_hash(strName) & ent->i16uHashMask];
+	for (; i != ENTRY_HASH_END; i = next[i]) {
 		if (strcmp(ent->ent[i].strVarName, strName) == 0)
 			return &ent->ent[i];
 	}
 	return NULL;
 }
 
+static int cmp_entry_pos(const void *a, const void *b)
+{
+	const piEntryPos *pa = a, *pb = b;
+
+	if (pa->i32uBitAddr != pb->i32uBitAddr)
+		return pa->i32uBitAddr < pb->i32uBitAddr ? -1 : 1;
+	return pa->i16uIndex - pb->i16uIndex;
+}
+
+static void build_entry_positions(piEntries * ent)
+{
+	uint32_t end, maxEnd = 0;
+	int i;
+
+	for (i = 0; i < ent->i16uNumEntries; i++) {
+		ent->pPos[i].i32uBitAddr = ent->ent[i].i16uOffset * 8 + ent->ent[i].i8uBitPos;
+		ent->pPos[i].i16uIndex = i;
+	}
+
+	sort(ent->pPos, ent->i16uNumEntries, sizeof(piEntryPos), cmp_entry_pos, NULL);
+
+	for (i = 0; i < ent->i16uNumEntries; i++) {
+		end = ent->pPos[i].i32uBitAddr + ent->ent[ent->pPos[i].i16uIndex].i16uBitLength;
+		if (end > maxEnd)
+			maxEnd = end;
+		ent->pPos[i].i32uMaxEnd = maxEnd;
+	}
+}
+
+SEntryInfo *piConfigFindEntryAt(piEntries * ent, uint16_t i16uOffset, uint8_t i8uBit)
+{
+	uint32_t pos = i16uOffset * 8 + i8uBit;
+	int lo = 0, hi = ent->i16uNumEntries, mid;
+	SEntryInfo *pEntry;
+
+	// find the first entry starting behind pos
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ent->pPos[mid].i32uBitAddr <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0 || ent->pPos[lo - 1].i32uMaxEnd <= pos)
+		return NULL;
+
+	// prefer the entry starting closest before pos, it is the innermost one
+	pEntry = &ent->ent[ent->pPos[lo - 1].i16uIndex];
+	if (pos < ent->pPos[lo - 1].i32uBitAddr + pEntry->i16uBitLength)
+		return pEntry;
+
+	// otherwise the first entry raising the end behind pos covers it
+	hi = lo - 1;
+	lo = 0;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ent->pPos[mid].i32uMaxEnd <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return &ent->ent[ent->pPos[lo].i16uIndex];
+}
+
 static piConnectionList *find_connections(json_val_t * element, piDevices * devs, piEntries * ent, piConnection * conn,
 					  int lvl)
 {
@@ -767,25 +868,35 @@ static piConnectionList *find_connections(json_val_t * element, piDevices * devs
 					   && */ strSrcName[0] != 0
 					   && strDstName[0] != 0) {
 					SEntryInfo *pSrcEntry, *pDstEntry;
-					pSrcEntry = search_entry(ent, strSrcName);
+					pSrcEntry = piConfigFindEntry(ent, strSrcName);
 					if (pSrcEntry == NULL) {
 						pr_err("error: connection variable %s unknown\n", strSrcName);
 						return NULL;
 					}
-					pDstEntry = search_entry(ent, strDstName);
+					pDstEntry = piConfigFindEntry(ent, strDstName);
 					if (pDstEntry == NULL) {
 						pr_err("error: connection variable %s unknown\n", strDstName);
 						return NULL;
 					}
+					if (pSrcEntry->i16uBitLength != pDstEntry->i16uBitLength
+					    || pSrcEntry->i16uBitLength == 0
+					    || (pSrcEntry->i16uBitLength > 8 && pSrcEntry->i16uBitLength != 16
+						&& pSrcEntry->i16uBitLength != 32)) {
+						// leave the length 0, the connection is skipped
+						pr_err("error: cannot connect %s to %s\n", strSrcName, strDstName);
+						return NULL;
+					}
 					conn->i16uSrcAddr = pSrcEntry->i16uOffset;
 					conn->i16uDestAddr = pDstEntry->i16uOffset;
 					conn->i8uLength = pSrcEntry->i16uBitLength;
 					if (conn->i8uLength < 8) {
 						conn->i8uSrcBit = pSrcEntry->i8uBitPos;
 						conn->i8uDestBit = pDstEntry->i8uBitPos;
+						conn->i8uMask = (1 << conn->i8uLength) - 1;
 					} else {
 						conn->i8uSrcBit = 0;
 						conn->i8uDestBit = 0;
+						conn->i8uMask = 0xff;
 					}
 					return NULL;	// return value is not used in this recursive call
 				} else {
@@ -881,6 +992,7 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 		  piConnectionList ** connl)
 {
 	int ret = 0, i, cnt, d, idx[4], exported_outputs;
+	size_t size, hsize, buckets;
 	json_config config;
 	json_val_t *root_structure;
 
@@ -924,11 +1036,20 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 	}
 	pr_info("%d entries in total\n", cnt);
 
-	*ent = kmalloc(sizeof(piEntries) + cnt * sizeof(SEntryInfo), GFP_KERNEL);
-	memset(*ent, 0, sizeof(piEntries) + cnt * sizeof(SEntryInfo));
+	// the hash index for the variable names and the index by position
+	// are stored behind the entries
+	size = sizeof(piEntries) + cnt * sizeof(SEntryInfo);
+	buckets = roundup_pow_of_two(max(cnt, 16));
+	hsize = ALIGN((buckets + cnt) * sizeof(uint16_t), sizeof(uint32_t));
+	*ent = kmalloc(size + hsize + cnt * sizeof(piEntryPos), GFP_KERNEL);
+	memset(*ent, 0, size);
 	(*ent)->i16uNumEntries = cnt;
+	(*ent)->i16uHashMask = buckets - 1;
+	(*ent)->pi16uHash = (uint16_t *) ((u8 *) *ent + size);
+	(*ent)->pPos = (piEntryPos *) ((u8 *) *ent + size + hsize);
 	cnt = 0;
 	find_entries(root_structure, *ent, &cnt, 0, 0, 1);
+	build_entry_hash(*ent);
 
 	// copy the config value into the module driver
 	piDIOComm_InitStart();
@@ -1049,6 +1170,8 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 			       (*devs)->dev[d].i16uOutputLength, (*devs)->dev[d].i16uConfigLength);
 	}
 
+	build_entry_positions(*ent);
+
 	*connl = find_connections(root_structure, *devs, *ent, NULL, 1);
 
 #ifdef DEBUG_CONFIG
@@ -1072,8 +1195,11 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 				exported_outputs = 0;
 			} else {
 				(*cl)->ent[d].i16uAddr = (*ent)->ent[i].i16uOffset;
-				(*cl)->ent[d].i8uBitMask =
-				    (0xff >> (8 - (*ent)->ent[i].i16uBitLength)) << (*ent)->ent[i].i8uBitPos;
+				if ((*ent)->ent[i].i16uBitLength >= 8)
+					(*cl)->ent[d].i8uBitMask = 0xff;
+				else
+					(*cl)->ent[d].i8uBitMask =
+					    (0xff >> (8 - (*ent)->ent[i].i16uBitLength)) << (*ent)->ent[i].i8uBitPos;
 				(*cl)->ent[d].i16uLength = (*ent)->ent[i].i16uBitLength;
 				d++;
 			}
@@ -1106,6 +1232,15 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 			// fasse die beiden Einträge zusammen
 			(*cl)->ent[i].i16uLength += (*cl)->ent[d].i16uLength;
 			(*cl)->ent[i].i8uBitMask |= (*cl)->ent[d].i8uBitMask;
+			if ((*cl)->ent[i].i8uBitMask == 0xff) {
+				// all bits of the byte are exported, copy it as a whole
+				(*cl)->ent[i].i16uLength = 8;
+				if (i > 0 && (*cl)->ent[i - 1].i16uLength >= 8
+				    && (*cl)->ent[i].i16uAddr == (*cl)->ent[i - 1].i16uAddr + (*cl)->ent[i - 1].i16uLength / 8) {
+					(*cl)->ent[i - 1].i16uLength += 8;
+					i--;
+				}
+			}
 		} else if ((*cl)->ent[i].i16uLength >= 8
 			   && (*cl)->ent[d].i16uLength >= 8
 			   && (*cl)->ent[d].i16uAddr == (*cl)->ent[i].i16uAddr + (*cl)->ent[i].i16uLength / 8) {
@@ -1131,6 +1266,21 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 	pr_info_config("copylist has %d entries\n", i);
 	(*cl)->i16uNumEntries = i;
 
+	// the ioctl copies this range from user space in one go
+	(*cl)->i16uStart = 0;
+	(*cl)->i16uLength = 0;
+	if (i > 0) {
+		uint16_t end = 0;
+
+		(*cl)->i16uStart = (*cl)->ent[0].i16uAddr;
+		for (d = 0; d < i; d++) {
+			uint16_t len = (*cl)->ent[d].i16uLength;
+
+			end = max_t(uint16_t, end, (*cl)->ent[d].i16uAddr + (len >= 8 ? len / 8 : 1));
+		}
+		(*cl)->i16uLength = end - (*cl)->i16uStart;
+	}
+
 	free_tree(root_structure);
 
 	return ret;
@@ -36,8 +36,17 @@
 #include "json.h"
 #include <piControl.h>
 
+typedef struct _piEntryPos {
+	uint32_t i32uBitAddr;	// offset * 8 + bit position of the entry
+	uint32_t i32uMaxEnd;	// largest end bit address of this and all preceding entries
+	uint16_t i16uIndex;	// index of the entry
+} piEntryPos;
+
 typedef struct _piEntries {
 	uint16_t i16uNumEntries;
+	uint16_t i16uHashMask;	// number of hash buckets - 1
+	uint16_t *pi16uHash;	// first entry of each bucket, followed by the next entry of each entry
+	piEntryPos *pPos;	// entries sorted by their position in the process image
 	SEntryInfo ent[0];
 } piEntries;
 
@@ -54,6 +63,8 @@ typedef struct _piCopyEntry {
 
 typedef struct _piCopylist {
 	uint16_t i16uNumEntries;
+	uint16_t i16uStart;	// first byte of the process image covered by the list
+	uint16_t i16uLength;	// number of bytes from i16uStart to the end of the last entry
 	piCopyEntry ent[0];
 } piCopylist;
 
@@ -63,6 +74,7 @@ typedef struct _piConnection {
 	uint8_t i8uLength;	// in bit: 1-7, 8, 16, 32
 	uint8_t i8uSrcBit;	// used only, if i8uLength < 8
 	uint8_t i8uDestBit;	// used only, if i8uLength < 8
+	uint8_t i8uMask;	// (1 << i8uLength) - 1, used only, if i8uLength < 8
 } piConnection;
 
 typedef struct _piConnectionlist {
@@ -76,5 +88,7 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 struct file *open_filename(const char *filename, int flags);
 void close_filename(struct file *file);
 void revpi_set_defaults(unsigned char *mem, piEntries *entries);
+SEntryInfo *piConfigFindEntry(piEntries *ent, const char *strName);
+SEntryInfo *piConfigFindEntryAt(piEntries *ent, uint16_t i16uOffset, uint8_t i8uBit);
 
 #endif
@@ -108,9 +108,22 @@
 #define  KB_CONFIG_STOP                     _IO(KB_IOC_MAGIC, 23 )  // for download of configuration to Master Gateway: stop IO communication completely
 #define  KB_CONFIG_SEND                     _IO(KB_IOC_MAGIC, 24 )  // for download of configuration to Master Gateway: download config data
 #define  KB_CONFIG_START                    _IO(KB_IOC_MAGIC, 25 )  // for download of configuration to Master Gateway: restart IO communication
-#define  KB_SET_OUTPUT_WATCHDOG             _IO(KB_IOC_MAGIC, 26 )  // activate a watchdog for this handle. If write is not called for a given period all outputs are set to 0
+#define  KB_SET_OUTPUT_WATCHDOG             _IO(KB_IOC_MAGIC, 26 )  // activate a watchdog for this handle. If write is not called for a given period all outputs are set to their default values
 #define  KB_SET_POS                         _IO(KB_IOC_MAGIC, 27 )  // set the f_pos, the unsigned int * is used to interpret the pos value
 #define  KB_AIO_CALIBRATE                   _IO(KB_IOC_MAGIC, 28 )
+#define  KB_GET_VALUES                      _IO(KB_IOC_MAGIC, 29 )  // get several values of the process image consistently in one call
+#define  KB_SET_VALUES                      _IO(KB_IOC_MAGIC, 30 )  // set several values of the process image atomically in one call
+#define  KB_WATCH_INPUTS                    _IO(KB_IOC_MAGIC, 31 )  // set the ranges of the process image watched for changes by this handle
+#define  KB_WAIT_FOR_CHANGE                 _IO(KB_IOC_MAGIC, 32 )  // wait until a watched range has changed
+#define  KB_FIND_VARIABLES                  _IO(KB_IOC_MAGIC, 33 )  // find several variables defined in piCtory
+#define  KB_FIND_ENTRY_AT                   _IO(KB_IOC_MAGIC, 34 )  // find the variable and module a bit of the process image belongs to
+#define  KB_STAGE_OUTPUTS                   _IO(KB_IOC_MAGIC, 35 )  // stage the data written by this handle until KB_COMMIT_OUTPUTS is called
+#define  KB_COMMIT_OUTPUTS                  _IO(KB_IOC_MAGIC, 36 )  // publish the staged data at the beginning of the next I/O cycle
+#define  KB_CLAIM_OUTPUTS                   _IO(KB_IOC_MAGIC, 37 )  // claim ranges of the process image exclusively for this handle
+#define  KB_GET_MODULE_STATS                _IO(KB_IOC_MAGIC, 38 )  // get the telegram statistics of a module
+#define  KB_SET_CYCLE_TIME                  _IO(KB_IOC_MAGIC, 39 )  // set the period of the I/O cycles on the PiBridge
+#define  KB_GET_CYCLE_TIME                  _IO(KB_IOC_MAGIC, 40 )  // get the period of the I/O cycles on the PiBridge
+#define  KB_SET_POLL_DIVISOR                _IO(KB_IOC_MAGIC, 41 )  // let a module on the PiBridge get a telegram only every n-th cycle
 
 #define  KB_WAIT_FOR_EVENT                  _IO(KB_IOC_MAGIC, 50 )  // wait for an event. This call is normally blocking
 #define  KB_EVENT_RESET                     1       // piControl was reset, reload configuration
@@ -119,6 +132,10 @@
 #define  KB_INTERN_SET_SERIAL_NUM           _IO(KB_IOC_MAGIC, 100 )  // set serial num in piDIO, piDI or piDO (can be made only once)
 #define  KB_INTERN_IO_MSG                   _IO(KB_IOC_MAGIC, 101 )  // send an I/O-Protocol message and return response
 
+// mmap() of PICONTROL_DEVICE: the process image is mapped at offset 0, a
+// read-only page with a struct pictl_status at PICONTROL_MMAP_STATUS_OFFSET
+#define  PICONTROL_MMAP_STATUS_OFFSET       4096
+
 #endif //WIN32
 
 typedef struct SDeviceInfoStr
@@ -141,7 +158,8 @@ typedef struct SDeviceInfoStr
     uint16_t    i16uEntries;            // number of entries in process image
     uint8_t     i8uModuleState;         // fieldbus state of piGate Module
     uint8_t     i8uActive;              // == 0 means that the module is not present and no data is available
-    uint8_t     i8uReserve[30];         // space for future extensions without changing the size of the struct
+    uint8_t     i8uPollDivisor;         // the module is polled every i8uPollDivisor cycles, 0 means every cycle
+    uint8_t     i8uReserve[29];         // space for future extensions without changing the size of the struct
 } SDeviceInfo;
 
 typedef struct SEntryInfoStr
@@ -193,6 +211,130 @@ struct pictl_calibrate {
 	signed short	y_val;
 };
 
+#define KB_FIND_VARIABLES_MAX	512	/* max. number of variables per call */
+
+struct pictl_find_variables {
+	/* number of variables, at most KB_FIND_VARIABLES_MAX */
+	uint32_t	count;
+	/* name of each variable, filled like KB_FIND_VARIABLE does */
+	SPIVariable	*vars;
+	/* configuration generation the result belongs to */
+	uint32_t	generation;
+};
+
+struct pictl_find_entry {
+	/* offset in the process image */
+	uint16_t	offset;
+	/* 0-7 bit position */
+	uint8_t		bit;
+	/* variable containing the bit, i8uAddress is the address of its module */
+	SEntryInfo	entry;
+};
+
+struct pictl_value_desc {
+	/* offset of the value in the process image */
+	uint16_t	offset;
+	/* 0-7 bit position if length is 1 */
+	uint8_t		bit;
+	/* length of the value in bits: 1 or a multiple of 8 */
+	uint16_t	length;
+};
+
+struct pictl_get_values {
+	/* number of descriptors */
+	uint32_t			count;
+	/* values to read */
+	const struct pictl_value_desc	*desc;
+	/* receives the values back to back: one byte (0/1) for a bit,
+	 * length / 8 bytes otherwise */
+	uint8_t				*data;
+};
+
+struct pictl_value {
+	/* value to write, length 1, 8, 16 or 32 */
+	struct pictl_value_desc	desc;
+	/* 0/1 for a bit, the value otherwise */
+	uint32_t		value;
+	/* only bits set in mask are written, not used for a bit */
+	uint32_t		mask;
+};
+
+struct pictl_set_values {
+	/* number of values */
+	uint32_t			count;
+	/* values to write */
+	const struct pictl_value	*vals;
+};
+
+struct pictl_watch {
+	/* first byte of the range in the process image */
+	uint16_t	offset;
+	/* number of bytes */
+	uint16_t	length;
+	/* bits watched in each byte, 0 for all */
+	uint8_t		mask;
+};
+
+struct pictl_watch_list {
+	/* number of watches, 0 removes all watches */
+	uint32_t			count;
+	/* ranges to watch */
+	const struct pictl_watch	*watch;
+};
+
+struct pictl_claim {
+	/* first byte of the range */
+	uint16_t	offset;
+	/* number of bytes */
+	uint16_t	length;
+};
+
+struct pictl_claim_list {
+	/* number of ranges, 0 releases all claims */
+	uint32_t			count;
+	/* ranges owned by the handle */
+	const struct pictl_claim	*claim;
+};
+
+#define PICONTROL_STAT_BUCKETS	16
+
+struct pictl_module_stats {
+	/* address of the module, set by the caller */
+	uint8_t		address;
+	/* number of answered cyclic telegrams */
+	uint32_t	count;
+	/* round trip time of the answered telegrams in us */
+	uint32_t	rtt_min;
+	uint32_t	rtt_avg;
+	uint32_t	rtt_max;
+	/* bucket 0: 0 us, bucket n: 2^(n-1) to 2^n - 1 us, the last bucket: all above */
+	uint32_t	rtt_hist[PICONTROL_STAT_BUCKETS];
+	/* telegrams with an invalid response */
+	uint32_t	crc_errors;
+	/* telegrams without response */
+	uint32_t	timeouts;
+	/* telegrams which could not be sent */
+	uint32_t	send_errors;
+	/* telegrams which failed for another reason */
+	uint32_t	other_errors;
+};
+
+struct pictl_cycle_time {
+	/* period of the I/O cycles in us, 0 runs the cycles back-to-back */
+	uint32_t	cycle_us;
+	/* minimum period of back-to-back cycles in us */
+	uint32_t	min_cycle_us;
+};
+
+#define PICONTROL_POLL_DIVISOR_MAX	32
+
+struct pictl_poll_divisor {
+	/* address of the module */
+	uint8_t		address;
+	/* the module gets a telegram every divisor cycles, 1 to PICONTROL_POLL_DIVISOR_MAX */
+	uint8_t		divisor;
+};
+
 #define CONFIG_DATA_SIZE 256
 
 typedef struct SConfigDataStr
@@ -202,6 +344,16 @@ typedef struct SConfigDataStr
     char        acData[CONFIG_DATA_SIZE];
 } SConfigData;
 
+struct pictl_status {
+	/* incremented before and after every write to the process image,
+	 * odd while a write is in progress */
+	uint32_t	seq;
+	/* number of completed I/O cycles */
+	uint32_t	cycle;
+	/* incremented whenever the configuration is reloaded by KB_RESET */
+	uint32_t	generation;
+};
+
 #define PICONTROL_CONFIG_ERROR_WRONG_MODULE_TYPE         -10
 #define PICONTROL_CONFIG_ERROR_WRONG_INPUT_LENGTH        -11
 #define PICONTROL_CONFIG_ERROR_WRONG_OUTPUT_LENGTH       -12
@@ -63,6 +63,11 @@
 #include <asm/div64.h>
 #include <linux/syscalls.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/debugfs.h>
+#include <linux/math64.h>
 
 #include "revpi_common.h"
 #include "revpi_core.h"
@@ -95,10 +100,12 @@ MODULE_SOFTDEP("pre: bcm2835-thermal "	/* cpu temp in process image */
 
 static int piControlOpen(struct inode *inode, struct file *file);
 static int piControlRelease(struct inode *inode, struct file *file);
-static ssize_t piControlRead(struct file *file, char __user * pBuf, size_t count, loff_t * ppos);
-static ssize_t piControlWrite(struct file *file, const char __user * pBuf, size_t count, loff_t * ppos);
+static ssize_t piControlRead(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t piControlWrite(struct kiocb *iocb, struct iov_iter *from);
 static loff_t piControlSeek(struct file *file, loff_t off, int whence);
 static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long usr_addr);
+static int piControlMmap(struct file *file, struct vm_area_struct *vma);
+static unsigned int piControlPoll(struct file *file, poll_table *wait);
 
 /******************************************************************************/
 /******************************  Global Vars  *********************************/
@@ -106,11 +113,13 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 
 static struct file_operations piControlFops = {
 owner:	THIS_MODULE,
-read:	piControlRead,
-write:	piControlWrite,
+read_iter:piControlRead,
+write_iter:piControlWrite,
 llseek:piControlSeek,
 open:	piControlOpen,
 unlocked_ioctl:piControlIoctl,
+mmap:	piControlMmap,
+poll:	piControlPoll,
 release:piControlRelease
 };
 
@@ -188,6 +197,7 @@ static char *piControlClass_devnode(struct device *dev, umode_t * mode)
 
 static int __init piControlInit(void)
 {
+	struct sched_param param = { };
 	int devindex = 0;
 	dev_t curdev;
 	int res;
@@ -274,12 +284,39 @@ static int __init piControlInit(void)
 	}
 
 	/* init some data */
+	BUILD_BUG_ON(KB_PI_LEN > PAGE_SIZE);
+	piDev_g.ai8uPI = (INT8U *) get_zeroed_page(GFP_KERNEL);
+	piDev_g.status = (struct pictl_status *) get_zeroed_page(GFP_KERNEL);
+	piDev_g.ai8uPISnap = kmalloc(KB_PI_LEN, GFP_KERNEL);
+	if (!piDev_g.ai8uPI || !piDev_g.status || !piDev_g.ai8uPISnap) {
+		pr_err("cannot allocate process image\n");
+		res = -ENOMEM;
+		goto err_free_image;
+	}
+
 	rt_mutex_init(&piDev_g.lockPI);
+	init_waitqueue_head(&piDev_g.wqCycle);
 	piDev_g.stopIO = false;
 
 	piDev_g.tLastOutput1 = ktime_set(0, 0);
 	piDev_g.tLastOutput2 = ktime_set(0, 0);
 
+	// expired output watchdogs are handled with the priority of the I/O thread
+	piDev_g.watchdogWorker = kthread_create_worker(0, "piControl watchdog");
+	if (IS_ERR(piDev_g.watchdogWorker)) {
+		pr_err("cannot create watchdog worker\n");
+		res = PTR_ERR(piDev_g.watchdogWorker);
+		goto err_free_image;
+	}
+	param.sched_priority = RT_PRIO_BRIDGE;
+	res = sched_setscheduler(piDev_g.watchdogWorker->task, SCHED_FIFO, &param);
+	if (res) {
+		pr_err("cannot set rt prio of watchdog worker\n");
+		goto err_destroy_worker;
+	}
+
+	piDev_g.debugfs = debugfs_create_dir("piControl", NULL);
+
 	/* start application */
 	if (piConfigParse(PICONFIG_FILE, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl, &piDev_g.connl) == 2) {
 		// file not found, try old location
@@ -325,8 +362,17 @@ err_revpi_fini:
 		revpi_compact_fini();
 	}
 err_free_config:
+	debugfs_remove_recursive(piDev_g.debugfs);
 	kfree(piDev_g.ent);
 	kfree(piDev_g.devs);
+	kfree(piDev_g.safeOutputs);
+	kfree(piDev_g.safeExported);
+err_destroy_worker:
+	kthread_destroy_worker(piDev_g.watchdogWorker);
+err_free_image:
+	kfree(piDev_g.ai8uPISnap);
+	free_page((unsigned long) piDev_g.status);
+	free_page((unsigned long) piDev_g.ai8uPI);
 err_dev_destroy:
 	device_destroy(piControlClass, curdev);
 err_class_destroy:
@@ -343,6 +389,7 @@ static int piControlReset(tpiControlInst * priv)
 {
 	int status = -EFAULT;
 	void *vptr;
+	piConnectionList *connl;
 	int timeout = 10000;	// ms
 
 	if (piDev_g.ent != NULL) {
@@ -360,13 +407,26 @@ static int piControlReset(tpiControlInst * priv)
 		piDev_g.cl = NULL;
 		kfree(vptr);
 	}
+	if (piDev_g.connl != NULL) {
+		// the I/O thread applies the connections under lockPI
+		revpi_image_write_lock();
+		vptr = piDev_g.connl;
+		piDev_g.connl = NULL;
+		revpi_image_write_unlock();
+		kfree(vptr);
+	}
 
 	/* start application */
-	if (piConfigParse(PICONFIG_FILE, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl, &piDev_g.connl) == 2) {
+	if (piConfigParse(PICONFIG_FILE, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl, &connl) == 2) {
 		// file not found, try old location
-		piConfigParse(PICONFIG_FILE_WHEEZY, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl, &piDev_g.connl);
+		piConfigParse(PICONFIG_FILE_WHEEZY, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl, &connl);
 		// ignore errors
 	}
+	revpi_image_write_lock();
+	piDev_g.connl = connl;
+	revpi_image_write_unlock();
+	// invalidate offsets cached by applications
+	WRITE_ONCE(piDev_g.status->generation, piDev_g.status->generation + 1);
 
 	if (piDev_g.machine_type == REVPI_CORE) {
 		PiBridgeMaster_Reset();
@@ -442,8 +502,15 @@ static void __exit piControlCleanup(void)
 		revpi_flat_fini();
 	}
 
+	kthread_destroy_worker(piDev_g.watchdogWorker);
+	debugfs_remove_recursive(piDev_g.debugfs);
 	kfree(piDev_g.ent);
 	kfree(piDev_g.devs);
+	kfree(piDev_g.safeOutputs);
+	kfree(piDev_g.safeExported);
+	kfree(piDev_g.ai8uPISnap);
+	free_page((unsigned long) piDev_g.status);
+	free_page((unsigned long) piDev_g.ai8uPI);
 	curdev = MKDEV(MAJOR(piControlMajor), MINOR(piControlMajor));
 	device_destroy(piControlClass, curdev);
 	class_destroy(piControlClass);
@@ -497,6 +564,98 @@ void printUserMsg(tpiControlInst *priv, const char *s, ...)
 	pr_info("%s", priv->pcErrorMessage);
 }
 
+/*****************************************************************************/
+/*              O W N E R S H I P                                            */
+/*****************************************************************************/
+// collect the bytes owned by all instances, lockListCon must be held
+static void piControlUpdateClaims(void)
+{
+	struct list_head *pCon;
+
+	bitmap_zero(piDev_g.claimed, KB_PI_LEN);
+	list_for_each(pCon, &piDev_g.listCon) {
+		tpiControlInst *inst = list_entry(pCon, tpiControlInst, list);
+
+		if (inst->claimed)
+			bitmap_or(piDev_g.claimed, piDev_g.claimed, inst->claimed, KB_PI_LEN);
+	}
+}
+
+// check if a handle may write to a range, lockListCon must be held
+static bool piControlMayWrite(tpiControlInst *priv, unsigned int offset, unsigned int len)
+{
+	unsigned int end = offset + len;
+
+	if (priv->claimed)
+		return find_next_zero_bit(priv->claimed, end, offset) >= end;
+
+	if (!piDev_g.claimers)
+		return true;
+
+	return find_next_bit(piDev_g.claimed, end, offset) >= end;
+}
+
+// check if the writes of a handle have to be checked against the claimed
+// ranges. Without any claim the writers neither take lockListCon nor search
+// the bitmaps; a claim becomes effective for the writes started after it.
+static bool piControlMustCheckWrite(tpiControlInst *priv)
+{
+	return READ_ONCE(priv->claimed) || smp_load_acquire(&piDev_g.claimers);
+}
+
+/*****************************************************************************/
+/*              W A T C H D O G                                              */
+/*****************************************************************************/
+// set the outputs of a handle to their default values
+static void piControlSetSafeState(tpiControlInst *priv)
+{
+	my_rt_mutex_lock(&piDev_g.lockListCon);
+	revpi_set_inst_safe_state(priv);
+	rt_mutex_unlock(&piDev_g.lockListCon);
+}
+
+static void piControlWatchdogWork(struct kthread_work *work)
+{
+	tpiControlInst *priv = container_of(work, tpiControlInst, watchdogWork);
+
+	my_rt_mutex_lock(&piDev_g.lockListCon);
+	if (READ_ONCE(priv->watchdogExpired)) {
+		WRITE_ONCE(priv->watchdogExpired, false);
+		revpi_set_inst_safe_state(priv);
+	}
+	rt_mutex_unlock(&piDev_g.lockListCon);
+}
+
+static enum hrtimer_restart piControlWatchdogExpired(struct hrtimer *timer)
+{
+	tpiControlInst *priv = container_of(timer, tpiControlInst, watchdog);
+	unsigned long ms = READ_ONCE(priv->tTimeoutDurationMs);
+
+	// lockPI cannot be taken in timer context, the outputs are set right
+	// away by the watchdog worker, which runs at the priority of the I/O thread
+	WRITE_ONCE(priv->watchdogExpired, true);
+	kthread_queue_work(piDev_g.watchdogWorker, &priv->watchdogWork);
+
+	if (ms == 0)
+		return HRTIMER_NORESTART;
+
+	// repeat until the outputs are written again
+	hrtimer_forward_now(timer, ms_to_ktime(ms));
+	return HRTIMER_RESTART;
+}
+
+// restart the watchdog, called whenever the outputs are written
+static void piControlWatchdogKick(tpiControlInst *priv)
+{
+	unsigned long ms = READ_ONCE(priv->tTimeoutDurationMs);
+
+	if (ms > 0) {
+		// the outputs were written, drop a reset not yet done
+		WRITE_ONCE(priv->watchdogExpired, false);
+		hrtimer_start(&priv->watchdog, ms_to_ktime(ms), HRTIMER_MODE_REL);
+	}
+}
+
 /*****************************************************************************/
 /*              O P E N                                                      */
 /*****************************************************************************/
@@ -518,6 +677,11 @@ static int piControlOpen(struct inode *inode, struct file *file)
 	rt_mutex_init(&priv->lockEventList);
 
 	init_waitqueue_head(&priv->wq);
+	priv->cycle = READ_ONCE(piDev_g.status->cycle);
+
+	hrtimer_init(&priv->watchdog, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	priv->watchdog.function = piControlWatchdogExpired;
+	kthread_init_work(&priv->watchdogWork, piControlWatchdogWork);
 
 	//pr_info("piControlOpen");
 	if (!waitRunning(3000)) {
@@ -557,16 +721,12 @@ static int piControlRelease(struct inode *inode, struct file *file)
 
 	priv = (tpiControlInst *) file->private_data;
 
-	if (priv->tTimeoutDurationMs > 0) {
-		// if the watchdog is active, set all outputs to 0
-		int i;
-		my_rt_mutex_lock(&piDev_g.lockPI);
-		for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
-			if (RevPiDevice_getDev(i)->i8uActive) {
-				memset(piDev_g.ai8uPI + RevPiDevice_getDev(i)->i16uOutputOffset, 0, RevPiDevice_getDev(i)->sId.i16uFBS_OutputLength);
-			}
-		}
-		rt_mutex_unlock(&piDev_g.lockPI);
+	hrtimer_cancel(&priv->watchdog);
+	kthread_cancel_work_sync(&priv->watchdogWork);
+
+	if (priv->tTimeoutDurationMs > 0 || priv->claimed) {
+		// if the watchdog is active, set the outputs to their default values
+		piControlSetSafeState(priv);
 	}
 
 	pr_info_drv("close instance %d/%d\n", priv->instNum, piDev_g.PnAppCon);
@@ -574,8 +734,21 @@ static int piControlRelease(struct inode *inode, struct file *file)
 
 	my_rt_mutex_lock(&piDev_g.lockListCon);
 	list_del(&priv->list);
+	if (priv->watchCnt)
+		piDev_g.watchers--;
+	if (priv->claimed) {
+		smp_store_release(&piDev_g.claimers, piDev_g.claimers - 1);
+		piControlUpdateClaims();
+	}
 	rt_mutex_unlock(&piDev_g.lockListCon);
 
+	kfree(priv->claimed);
+	kfree(priv->claimSafe);
+	kfree(priv->stage);
+	kfree(priv->watch);
+	kfree(priv->watchData);
+	kfree(priv->watchChanged);
+
 	list_for_each_safe(pos, n, &priv->piEventList) {
 		tpiEventEntry *pos_inst;
 		pos_inst = list_entry(pos, tpiEventEntry, list);
@@ -591,45 +764,54 @@ static int piControlRelease(struct inode *inode, struct file *file)
 /*****************************************************************************/
 /*    R E A D                                                                */
 /*****************************************************************************/
-static ssize_t piControlRead(struct file *file, char __user * pBuf, size_t count, loff_t * ppos)
+// Used for read(), pread() and their vectored variants. The position is
+// taken from the iocb, so pread() does not depend on the shared f_pos and
+// all segments of a readv() come from the same snapshot.
+static ssize_t piControlRead(struct kiocb *iocb, struct iov_iter *to)
 {
 	tpiControlInst *priv;
 	INT8U *pPd;
+	loff_t pos = iocb->ki_pos;
+	size_t count = iov_iter_count(to);
 	size_t nread = count;
 
-	if (file == 0 || pBuf == 0 || ppos == 0)
-		return -EINVAL;
-
 	if (!isRunning())
 		return -EAGAIN;
 
-	priv = (tpiControlInst *) file->private_data;
+	priv = (tpiControlInst *) iocb->ki_filp->private_data;
 
-	dev_dbg(priv->dev, "piControlRead Count: %u, Pos: %llu", count, *ppos);
+	dev_dbg(priv->dev, "piControlRead Count: %u, Pos: %llu", count, pos);
 
-	if (*ppos < 0 || *ppos >= KB_PI_LEN) {
+	// any read acknowledges the current cycle for poll()
+	priv->cycle = smp_load_acquire(&piDev_g.status->cycle);
+
+	if (pos < 0 || pos >= KB_PI_LEN) {
 		return 0;	// end of file
 	}
 
-	if (nread + *ppos > KB_PI_LEN) {
-		nread = KB_PI_LEN - *ppos;
+	if (nread + pos > KB_PI_LEN) {
+		nread = KB_PI_LEN - pos;
 	}
 
-	pPd = piDev_g.ai8uPI + *ppos;
+	pPd = kmalloc(nread, GFP_KERNEL);
+	if (!pPd)
+		return -ENOMEM;
+
+	// take a consistent snapshot without blocking the I/O thread
+	revpi_image_read(pPd, piDev_g.ai8uPI + pos, nread);
 
 #ifdef VERBOSE
-	pr_info("piControlRead inst %d Count=%u, Pos=%llu: %02x %02x\n", priv->instNum, count, *ppos, pPd[0], pPd[1]);
+	pr_info("piControlRead inst %d Count=%u, Pos=%llu: %02x %02x\n", priv->instNum, count, pos, pPd[0], pPd[1]);
 #endif
 
-	my_rt_mutex_lock(&piDev_g.lockPI);
-	if (copy_to_user(pBuf, pPd, nread) != 0) {
-		rt_mutex_unlock(&piDev_g.lockPI);
+	if (copy_to_iter(pPd, nread, to) != nread) {
+		kfree(pPd);
 		pr_err("piControlRead: copy_to_user failed");
 		return -EFAULT;
 	}
-	rt_mutex_unlock(&piDev_g.lockPI);
+	kfree(pPd);
 
-	*ppos += nread;
+	iocb->ki_pos = pos + nread;
 
 	return nread;		// length read
 }
@@ -637,44 +819,70 @@ static ssize_t piControlRead(struct file *file, char __user * pBuf, size_t count
 /*****************************************************************************/
 /*    W R I T E                                                              */
 /*****************************************************************************/
-static ssize_t piControlWrite(struct file *file, const char __user * pBuf, size_t count, loff_t * ppos)
+// Used for write(), pwrite() and their vectored variants, see piControlRead.
+static ssize_t piControlWrite(struct kiocb *iocb, struct iov_iter *from)
 {
 	tpiControlInst *priv;
 	INT8U *pPd;
+	loff_t pos = iocb->ki_pos;
+	size_t count = iov_iter_count(from);
 	size_t nwrite = count;
+	bool locked;
 
 	if (!isRunning())
 		return -EAGAIN;
 
-	priv = (tpiControlInst *) file->private_data;
+	priv = (tpiControlInst *) iocb->ki_filp->private_data;
 
-	dev_dbg(priv->dev, "piControlWrite Count: %u, Pos: %llu", count, *ppos);
+	dev_dbg(priv->dev, "piControlWrite Count: %u, Pos: %llu", count, pos);
 
-	if (*ppos < 0 || *ppos >= KB_PI_LEN) {
+	if (pos < 0 || pos >= KB_PI_LEN) {
 		return 0;	// end of file
 	}
 
-	if (nwrite + *ppos > KB_PI_LEN) {
-		nwrite = KB_PI_LEN - *ppos;
+	if (nwrite + pos > KB_PI_LEN) {
+		nwrite = KB_PI_LEN - pos;
 	}
 
-	pPd = piDev_g.ai8uPI + *ppos;
+	// fetch the data before locking, a page fault must not stall the I/O
+	pPd = kmalloc(nwrite, GFP_KERNEL);
+	if (!pPd)
+		return -ENOMEM;
 
-	my_rt_mutex_lock(&piDev_g.lockPI);
-	if (copy_from_user(pPd, pBuf, nwrite) != 0) {
-		rt_mutex_unlock(&piDev_g.lockPI);
+	if (copy_from_iter(pPd, nwrite, from) != nwrite) {
+		kfree(pPd);
 		pr_err("piControlWrite: copy_from_user failed");
 		return -EFAULT;
 	}
-	rt_mutex_unlock(&piDev_g.lockPI);
+
+	// staged outputs are committed under lockListCon as well
+	locked = piControlMustCheckWrite(priv) || READ_ONCE(priv->stage);
+	if (locked) {
+		my_rt_mutex_lock(&piDev_g.lockListCon);
+		if (!piControlMayWrite(priv, pos, nwrite)) {
+			rt_mutex_unlock(&piDev_g.lockListCon);
+			kfree(pPd);
+			return -EACCES;
+		}
+	}
+
+	if (locked && priv->stage) {
+		memcpy(priv->stage->data + pos, pPd, nwrite);
+		bitmap_set(priv->stage->dirty, pos, nwrite);
+	} else {
+		revpi_image_write_lock();
+		memcpy(piDev_g.ai8uPI + pos, pPd, nwrite);
+		revpi_image_write_unlock();
+	}
+	if (locked)
+		rt_mutex_unlock(&piDev_g.lockListCon);
 #ifdef VERBOSE
-	pr_info("piControlWrite Count=%u, Pos=%llu: %02x %02x\n", count, *ppos, pPd[0], pPd[1]);
+	pr_info("piControlWrite Count=%u, Pos=%llu: %02x %02x\n", count, pos, pPd[0], pPd[1]);
 #endif
-	*ppos += nwrite;
+	kfree(pPd);
+	iocb->ki_pos = pos + nwrite;
 
-	if (priv->tTimeoutDurationMs > 0) {
-		priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-	}
+	piControlWatchdogKick(priv);
 
 	return nwrite;		// length written
 }
@@ -716,9 +924,112 @@ static loff_t piControlSeek(struct file *file, loff_t off, int whence)
 	return newpos;
 }
 
+/*****************************************************************************/
+/*    M M A P                                                                */
+/*****************************************************************************/
+static int piControlMmap(struct file *file, struct vm_area_struct *vma)
+{
+	void *page;
+
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	if (vma->vm_pgoff == 0) {
+		// The process image. Inputs and outputs share the page, so
+		// access is granted according to the open mode of the file.
+		// Inputs written by the application are overwritten in the
+		// next I/O cycle, as with write().
+		page = piDev_g.ai8uPI;
+	} else if (vma->vm_pgoff == PICONTROL_MMAP_STATUS_OFFSET / PAGE_SIZE) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+		page = piDev_g.status;
+	} else {
+		return -EINVAL;
+	}
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(page) >> PAGE_SHIFT,
+			       PAGE_SIZE, vma->vm_page_prot);
+}
+
+/*****************************************************************************/
+/*    P O L L                                                                */
+/*****************************************************************************/
+static unsigned int piControlPoll(struct file *file, poll_table *wait)
+{
+	tpiControlInst *priv = (tpiControlInst *) file->private_data;
+	unsigned int mask = POLLOUT | POLLWRNORM;
+
+	poll_wait(file, &piDev_g.wqCycle, wait);
+	poll_wait(file, &priv->wq, wait);
+
+	if (READ_ONCE(priv->watchCnt)) {
+		// a watched range has changed
+		if (READ_ONCE(priv->watchPending))
+			mask |= POLLIN | POLLRDNORM;
+	} else {
+		// new inputs since the last read
+		if (smp_load_acquire(&piDev_g.status->cycle) != priv->cycle)
+			mask |= POLLIN | POLLRDNORM;
+	}
+
+	// pending event for KB_WAIT_FOR_EVENT
+	if (!list_empty(&priv->piEventList))
+		mask |= POLLPRI;
+
+	return mask;
+}
+
 /*****************************************************************************/
 /*    I O C T L                                                           */
 /*****************************************************************************/
+// size of a value in the process image in bytes, 0 if it is invalid
+static unsigned int piControlValueSize(const struct pictl_value_desc *desc)
+{
+	unsigned int size;
+
+	if (desc->length == 1) {
+		if (desc->bit >= 8)
+			return 0;
+		size = 1;
+	} else {
+		if (desc->length == 0 || desc->length % 8)
+			return 0;
+		size = desc->length / 8;
+	}
+
+	if (desc->offset + size > KB_PI_LEN)
+		return 0;
+
+	return size;
+}
+
+// write a value to the process image, lockPI must be held for writing
+static void piControlSetValue(const struct pictl_value *val)
+{
+	u8 *p = piDev_g.ai8uPI + val->desc.offset;
+	int i;
+
+	if (val->desc.length == 1) {
+		if (val->value)
+			*p |= (1 << val->desc.bit);
+		else
+			*p &= ~(1 << val->desc.bit);
+		return;
+	}
+
+	// the process image is little endian and values need not be aligned
+	for (i = 0; i < val->desc.length / 8; i++) {
+		u8 mask = val->mask >> (8 * i);
+
+		p[i] = (p[i] & ~mask) | ((val->value >> (8 * i)) & mask);
+	}
+}
+
 static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long usr_addr)
 {
 	int status = -EFAULT;
@@ -788,6 +1099,7 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				dev_info.i16uConfigLength = RevPiDevice_getDev(i)->i16uConfigLength;
 				dev_info.i16uConfigOffset = RevPiDevice_getDev(i)->i16uConfigOffset;
 				dev_info.i8uModuleState = RevPiDevice_getDev(i)->i8uModuleState;
+				dev_info.i8uPollDivisor = RevPiDevice_getDev(i)->i8uPollDivisor;
 
 				if (__copy_to_user((void * __user) usr_addr, &dev_info, sizeof(dev_info))) {
 					pr_err("failed to copy dev info to user\n");
@@ -830,6 +1142,7 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				dev_infos[i].i16uConfigLength = RevPiDevice_getDev(i)->i16uConfigLength;
 				dev_infos[i].i16uConfigOffset = RevPiDevice_getDev(i)->i16uConfigOffset;
 				dev_infos[i].i8uModuleState = RevPiDevice_getDev(i)->i8uModuleState;
+				dev_infos[i].i8uPollDivisor = RevPiDevice_getDev(i)->i8uPollDivisor;
 
 				if (	dev_infos[i].i16uModuleType == KUNBUS_FW_DESCR_TYP_PI_DIO_14
 				||	dev_infos[i].i16uModuleType == KUNBUS_FW_DESCR_TYP_PI_DO_16
@@ -886,9 +1199,7 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			if (spi_val.i16uAddress >= KB_PI_LEN) {
 				status = -EFAULT;
 			} else {
-				rt_mutex_lock(&piDev_g.lockPI);
-				val = piDev_g.ai8uPI[spi_val.i16uAddress];
-				rt_mutex_unlock(&piDev_g.lockPI);
+				val = READ_ONCE(piDev_g.ai8uPI[spi_val.i16uAddress]);
 
 				if (spi_val.i8uBit >= 8) {
 					spi_val.i8uValue = val;
@@ -925,7 +1236,17 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				status = -EFAULT;
 			} else {
 				INT8U i8uValue_l;
-				my_rt_mutex_lock(&piDev_g.lockPI);
+				bool locked = piControlMustCheckWrite(priv);
+
+				if (locked) {
+					my_rt_mutex_lock(&piDev_g.lockListCon);
+					if (!piControlMayWrite(priv, spi_val.i16uAddress, 1)) {
+						rt_mutex_unlock(&piDev_g.lockListCon);
+						return -EACCES;
+					}
+				}
+
+				revpi_image_write_lock();
 				i8uValue_l = piDev_g.ai8uPI[spi_val.i16uAddress];
 
 				if (spi_val.i8uBit >= 8) {
@@ -938,11 +1259,11 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				}
 
 				piDev_g.ai8uPI[spi_val.i16uAddress] = i8uValue_l;
-				rt_mutex_unlock(&piDev_g.lockPI);
+				revpi_image_write_unlock();
+				if (locked)
+					rt_mutex_unlock(&piDev_g.lockListCon);
 
-				if (priv->tTimeoutDurationMs > 0) {
-					priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-				}
+				piControlWatchdogKick(priv);
 
 #ifdef VERBOSE
 				pr_info("piControlIoctl Addr=%u, bit=%u: %02x %02x\n", spi_val.i16uAddress, spi_val.i8uBit, spi_val.i8uValue, i8uValue_l);
@@ -953,9 +1274,155 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		}
 		break;
 
-	case KB_FIND_VARIABLE:
+	case KB_GET_VALUES:
+		{
+			struct pictl_get_values vals;
+			struct pictl_value_desc *desc;
+			unsigned int size;
+			size_t len = 0;
+			u8 *data, *p;
+			u32 seq;
+			int i;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (copy_from_user(&vals, (const void __user *) usr_addr,
+					   sizeof(vals))) {
+				pr_err("failed to copy value list from user\n");
+				return -EFAULT;
+			}
+
+			if (vals.count == 0 || vals.count > KB_PI_LEN)
+				return -EINVAL;
+
+			desc = memdup_user((const void __user *) vals.desc,
+					   vals.count * sizeof(*desc));
+			if (IS_ERR(desc)) {
+				pr_err("failed to copy value descriptors from user\n");
+				return PTR_ERR(desc);
+			}
+
+			for (i = 0; i < vals.count; i++) {
+				size = piControlValueSize(&desc[i]);
+				if (size == 0) {
+					printUserMsg(priv, "invalid value %d: offset %d bit %d length %d",
+						     i, desc[i].offset, desc[i].bit, desc[i].length);
+					kfree(desc);
+					return -EINVAL;
+				}
+				len += size;
+			}
+
+			// keep the buffer in the range of kmalloc
+			if (len > KB_PI_LEN * 4) {
+				printUserMsg(priv, "values too long: %zu bytes", len);
+				kfree(desc);
+				return -EINVAL;
+			}
+
+			data = kmalloc(len, GFP_KERNEL);
+			if (!data) {
+				kfree(desc);
+				return -ENOMEM;
+			}
+
+			// gather all values from the same snapshot
+			priv->cycle = smp_load_acquire(&piDev_g.status->cycle);
+			do {
+				seq = revpi_image_read_begin();
+				for (i = 0, p = data; i < vals.count; i++) {
+					if (desc[i].length == 1) {
+						*p++ = (piDev_g.ai8uPI[desc[i].offset] >> desc[i].bit) & 1;
+					} else {
+						memcpy(p, piDev_g.ai8uPI + desc[i].offset, desc[i].length / 8);
+						p += desc[i].length / 8;
+					}
+				}
+			} while (revpi_image_read_retry(seq));
+
+			if (copy_to_user((void __user *) vals.data, data, len)) {
+				pr_err("failed to copy values to user\n");
+				status = -EFAULT;
+			} else {
+				status = 0;
+			}
+
+			kfree(data);
+			kfree(desc);
+		}
+		break;
+
+	case KB_SET_VALUES:
 		{
+			struct pictl_set_values vals;
+			struct pictl_value *val;
+			bool locked;
 			int i;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (copy_from_user(&vals, (const void __user *) usr_addr,
+					   sizeof(vals))) {
+				pr_err("failed to copy value list from user\n");
+				return -EFAULT;
+			}
+
+			if (vals.count == 0 || vals.count > KB_PI_LEN)
+				return -EINVAL;
+
+			val = memdup_user((const void __user *) vals.vals,
+					  vals.count * sizeof(*val));
+			if (IS_ERR(val)) {
+				pr_err("failed to copy values from user\n");
+				return PTR_ERR(val);
+			}
+
+			for (i = 0; i < vals.count; i++) {
+				// only the sizes of the C integer types, as documented
+				if ((val[i].desc.length != 1 && val[i].desc.length != 8 &&
+				     val[i].desc.length != 16 && val[i].desc.length != 32) ||
+				    piControlValueSize(&val[i].desc) == 0) {
+					printUserMsg(priv, "invalid value %d: offset %d bit %d length %d",
+						     i, val[i].desc.offset, val[i].desc.bit, val[i].desc.length);
+					kfree(val);
+					return -EINVAL;
+				}
+			}
+
+			locked = piControlMustCheckWrite(priv);
+			if (locked) {
+				my_rt_mutex_lock(&piDev_g.lockListCon);
+				for (i = 0; i < vals.count; i++) {
+					if (!piControlMayWrite(priv, val[i].desc.offset,
+							       piControlValueSize(&val[i].desc))) {
+						rt_mutex_unlock(&piDev_g.lockListCon);
+						kfree(val);
+						return -EACCES;
+					}
+				}
+			}
+
+			// all or nothing, so that related outputs are never torn
+			revpi_image_write_lock();
+			for (i = 0; i < vals.count; i++)
+				piControlSetValue(&val[i]);
+			revpi_image_write_unlock();
+			if (locked)
+				rt_mutex_unlock(&piDev_g.lockListCon);
+
+			kfree(val);
+
+			piControlWatchdogKick(priv);
+
+			status = 0;
+		}
+		break;
+
+	case KB_FIND_VARIABLE:
+		{
+			SEntryInfo *pEntry;
 			SPIVariable spi_var;
 			int namelen;
 			const char __user *usr_name;
@@ -983,15 +1450,12 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			spi_var.i8uBit = 0xff;
 			spi_var.i16uLength = 0xffff;
 
-			for (i = 0; i < piDev_g.ent->i16uNumEntries; i++) {
-				//pr_info("strcmp(%s, %s)\n", piDev_g.ent->ent[i].strVarName, var->strVarName);
-				if (strcmp(piDev_g.ent->ent[i].strVarName, spi_var.strVarName) == 0) {
-					spi_var.i16uAddress = piDev_g.ent->ent[i].i16uOffset;
-					spi_var.i8uBit = piDev_g.ent->ent[i].i8uBitPos;
-					spi_var.i16uLength = piDev_g.ent->ent[i].i16uBitLength;
-					status = 0;
-					break;
-				}
+			pEntry = piConfigFindEntry(piDev_g.ent, spi_var.strVarName);
+			if (pEntry) {
+				spi_var.i16uAddress = pEntry->i16uOffset;
+				spi_var.i8uBit = pEntry->i8uBitPos;
+				spi_var.i16uLength = pEntry->i16uBitLength;
+				status = 0;
 			}
 
 			if (copy_to_user((void __user *) usr_addr, &spi_var, sizeof(spi_var))) {
@@ -1002,8 +1466,102 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		}
 		break;
 
+	case KB_FIND_VARIABLES:
+		{
+			struct pictl_find_variables find;
+			SPIVariable *vars;
+			SEntryInfo *pEntry;
+			int i;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (copy_from_user(&find, (const void __user *) usr_addr,
+					   sizeof(find))) {
+				pr_err("failed to copy variable list from user\n");
+				return -EFAULT;
+			}
+
+			if (find.count == 0 || find.count > KB_FIND_VARIABLES_MAX)
+				return -EINVAL;
+
+			vars = memdup_user((const void __user *) find.vars,
+					   find.count * sizeof(*vars));
+			if (IS_ERR(vars)) {
+				pr_err("failed to copy spi variables from user\n");
+				return PTR_ERR(vars);
+			}
+
+			find.generation = READ_ONCE(piDev_g.status->generation);
+			status = 0;
+			for (i = 0; i < find.count; i++) {
+				/* make sure we have a valid string */
+				vars[i].strVarName[sizeof(vars[i].strVarName) - 1] = '\0';
+
+				pEntry = piDev_g.ent ? piConfigFindEntry(piDev_g.ent, vars[i].strVarName) : NULL;
+				if (pEntry) {
+					vars[i].i16uAddress = pEntry->i16uOffset;
+					vars[i].i8uBit = pEntry->i8uBitPos;
+					vars[i].i16uLength = pEntry->i16uBitLength;
+					status++;
+				} else {
+					vars[i].i16uAddress = 0xffff;
+					vars[i].i8uBit = 0xff;
+					vars[i].i16uLength = 0xffff;
+				}
+			}
+
+			if (copy_to_user((void __user *) find.vars, vars, find.count * sizeof(*vars))
+			    || copy_to_user((void __user *) usr_addr, &find, sizeof(find))) {
+				pr_err("failed to copy spi variables to user\n");
+				status = -EFAULT;
+			}
+			kfree(vars);
+		}
+		break;
+
+	case KB_FIND_ENTRY_AT:
+		{
+			struct pictl_find_entry find;
+			SEntryInfo *pEntry;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (!piDev_g.ent) {
+				status = -ENOENT;
+				break;
+			}
+
+			if (copy_from_user(&find, (const void __user *) usr_addr,
+					   sizeof(find))) {
+				pr_err("failed to copy offset from user\n");
+				return -EFAULT;
+			}
+
+			if (find.offset >= KB_PI_LEN || find.bit >= 8)
+				return -EINVAL;
+
+			pEntry = piConfigFindEntryAt(piDev_g.ent, find.offset, find.bit);
+			if (!pEntry) {
+				status = -ENOENT;
+				break;
+			}
+
+			find.entry = *pEntry;
+			if (copy_to_user((void __user *) usr_addr, &find, sizeof(find))) {
+				pr_err("failed to copy entry to user\n");
+				return -EFAULT;
+			}
+			status = 0;
+		}
+		break;
+
 	case KB_SET_EXPORTED_OUTPUTS:
 		{
+			piCopylist *cl = piDev_g.cl;
+			uint8_t *stage;
+			bool locked;
 			int i;
 			ktime_t now;
 
@@ -1015,61 +1573,61 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				return -EINVAL;
 			}
 
-			if (piDev_g.cl == 0 || piDev_g.cl->ent == 0 || piDev_g.cl->i16uNumEntries == 0)
+			if (cl == 0 || cl->i16uNumEntries == 0)
 				return 0;	// nothing to do
 
+			// fetch the user buffer before taking lockPI, a page fault must not stall the I/O thread
+			stage = kmalloc(cl->i16uLength, GFP_KERNEL);
+			if (!stage)
+				return -ENOMEM;
+
+			if (copy_from_user(stage, (const void __user *) (usr_addr + cl->i16uStart), cl->i16uLength)) {
+				pr_err("failed to copy exported outputs from user\n");
+				kfree(stage);
+				return -EFAULT;
+			}
+
+			locked = piControlMustCheckWrite(priv);
+			if (locked) {
+				my_rt_mutex_lock(&piDev_g.lockListCon);
+				for (i = 0; i < cl->i16uNumEntries; i++) {
+					uint16_t len = cl->ent[i].i16uLength;
+
+					if (!piControlMayWrite(priv, cl->ent[i].i16uAddr,
+							       len >= 8 ? len / 8 : 1)) {
+						rt_mutex_unlock(&piDev_g.lockListCon);
+						kfree(stage);
+						return -EACCES;
+					}
+				}
+			}
+
 			status = 0;
 			now = ktime_get();
 
-			my_rt_mutex_lock(&piDev_g.lockPI);
+			revpi_image_write_lock();
 			piDev_g.tLastOutput2 = piDev_g.tLastOutput1;
 			piDev_g.tLastOutput1 = now;
 
-			for (i = 0; i < piDev_g.cl->i16uNumEntries; i++) {
-				uint16_t len = piDev_g.cl->ent[i].i16uLength;
-				uint16_t addr = piDev_g.cl->ent[i].i16uAddr;
+			for (i = 0; i < cl->i16uNumEntries; i++) {
+				uint16_t len = cl->ent[i].i16uLength;
+				uint16_t addr = cl->ent[i].i16uAddr;
+				const uint8_t *src = stage + addr - cl->i16uStart;
 
 				if (len >= 8) {
-					len /= 8;
-					if (copy_from_user(piDev_g.ai8uPI + addr, (void *)(usr_addr + addr), len) != 0) {
-						status = -EFAULT;
-						break;
-					}
+					memcpy(piDev_g.ai8uPI + addr, src, len / 8);
 				} else {
-					uint8_t val1, val2;
-					uint8_t mask = piDev_g.cl->ent[i].i8uBitMask;
-
-					if (get_user(val1, (u8 __user*) (usr_addr + addr))) {
-						pr_err("failed to copy byte from user\n");
-						status = -EFAULT;
-						break;
-					}
-
-					val1 &= mask;
+					uint8_t mask = cl->ent[i].i8uBitMask;
 
-					val2 = piDev_g.ai8uPI[addr];
-					val2 &= ~mask;
-					val2 |= val1;
-					piDev_g.ai8uPI[addr] = val2;
-
-					//pr_info("piControlIoctl copy mask %02x at offset %d\n", mask, addr);
+					piDev_g.ai8uPI[addr] = (piDev_g.ai8uPI[addr] & ~mask) | (*src & mask);
 				}
-#if 0
-				pr_info("piControlIoctl inst %d time %5d: copy %d bits at offset %d: %x %x %x %x\n",
-					priv->instNum,
-					(int)(ktime_to_ms(now)) % 10000,
-					len, addr,
-					((unsigned char *)(usr_addr + addr))[0],
-					((unsigned char *)(usr_addr + addr))[1],
-					((unsigned char *)(usr_addr + addr))[2],
-					((unsigned char *)(usr_addr + addr))[3]);
-#endif
 			}
-			rt_mutex_unlock(&piDev_g.lockPI);
+			revpi_image_write_unlock();
+			if (locked)
+				rt_mutex_unlock(&piDev_g.lockListCon);
+			kfree(stage);
 
-			if (priv->tTimeoutDurationMs > 0) {
-				priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-			}
+			piControlWatchdogKick(priv);
 		}
 		break;
 
@@ -1355,6 +1913,129 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		}
 		break;
 
+	case KB_WATCH_INPUTS:
+		{
+			struct pictl_watch_list list;
+			struct pictl_watch *watch = NULL;
+			u8 *data = NULL, *changed = NULL;
+			size_t len = 0;
+			u32 seq;
+			int i;
+
+			if (copy_from_user(&list, (const void __user *) usr_addr,
+					   sizeof(list))) {
+				pr_err("failed to copy watch list from user\n");
+				return -EFAULT;
+			}
+
+			if (list.count > KB_PI_LEN)
+				return -EINVAL;
+
+			if (list.count) {
+				watch = memdup_user((const void __user *) list.watch,
+						    list.count * sizeof(*watch));
+				if (IS_ERR(watch)) {
+					pr_err("failed to copy watches from user\n");
+					return PTR_ERR(watch);
+				}
+
+				for (i = 0; i < list.count; i++) {
+					if (watch[i].length == 0 ||
+					    watch[i].offset + watch[i].length > KB_PI_LEN) {
+						printUserMsg(priv, "invalid watch %d: offset %d length %d",
+							     i, watch[i].offset, watch[i].length);
+						kfree(watch);
+						return -EINVAL;
+					}
+					len += watch[i].length;
+				}
+
+				// keep the buffer in the range of kmalloc
+				if (len > KB_PI_LEN * 4) {
+					printUserMsg(priv, "watches too long: %zu bytes", len);
+					kfree(watch);
+					return -EINVAL;
+				}
+
+				data = kmalloc(len, GFP_KERNEL);
+				changed = kcalloc(list.count, 1, GFP_KERNEL);
+				if (!data || !changed) {
+					kfree(watch);
+					kfree(data);
+					kfree(changed);
+					return -ENOMEM;
+				}
+			}
+
+			my_rt_mutex_lock(&piDev_g.lockListCon);
+			// start from the current state of the inputs
+			do {
+				u8 *p = data;
+
+				seq = revpi_image_read_begin();
+				for (i = 0; i < list.count; i++) {
+					memcpy(p, piDev_g.ai8uPI + watch[i].offset, watch[i].length);
+					p += watch[i].length;
+				}
+			} while (revpi_image_read_retry(seq));
+
+			if (priv->watchCnt)
+				piDev_g.watchers--;
+			if (list.count)
+				piDev_g.watchers++;
+
+			swap(priv->watch, watch);
+			swap(priv->watchData, data);
+			swap(priv->watchChanged, changed);
+			priv->watchCnt = list.count;
+			priv->watchPending = false;
+			rt_mutex_unlock(&piDev_g.lockListCon);
+
+			kfree(watch);
+			kfree(data);
+			kfree(changed);
+			status = 0;
+		}
+		break;
+
+	case KB_WAIT_FOR_CHANGE:
+		{
+			u8 *changed;
+			u32 cnt;
+			int i;
+
+			if (!READ_ONCE(priv->watchCnt))
+				return -EINVAL;
+
+			if (file->f_flags & O_NONBLOCK) {
+				if (!READ_ONCE(priv->watchPending))
+					return -EAGAIN;
+			} else if (wait_event_interruptible(priv->wq, READ_ONCE(priv->watchPending))) {
+				return -ERESTARTSYS;
+			}
+
+			my_rt_mutex_lock(&piDev_g.lockListCon);
+			cnt = priv->watchCnt;
+			changed = kmemdup(priv->watchChanged, cnt, GFP_KERNEL);
+			if (!changed) {
+				rt_mutex_unlock(&piDev_g.lockListCon);
+				return -ENOMEM;
+			}
+			memset(priv->watchChanged, 0, cnt);
+			priv->watchPending = false;
+			rt_mutex_unlock(&piDev_g.lockListCon);
+
+			if (copy_to_user((void __user *) usr_addr, changed, cnt)) {
+				pr_err("failed to copy changes to user\n");
+				status = -EFAULT;
+			} else {
+				for (i = 0, status = 0; i < cnt; i++)
+					status += changed[i];
+			}
+			kfree(changed);
+		}
+		break;
+
 	case KB_GET_LAST_MESSAGE:
 		{
 			if (copy_to_user((void *)usr_addr, priv->pcErrorMessage, sizeof(priv->pcErrorMessage))) {
@@ -1460,15 +2141,266 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		}
 		break;
 
+	case KB_STAGE_OUTPUTS:
+		{
+			struct revpi_stage *st = NULL;
+			u32 data;
+
+			if (get_user(data, (u32 __user *) usr_addr)) {
+				pr_err("failed to copy staging mode from user\n");
+				return -EFAULT;
+			}
+
+			if (data) {
+				st = kzalloc(sizeof(*st), GFP_KERNEL);
+				if (!st)
+					return -ENOMEM;
+			}
+
+			// staged and committed outputs not yet published are dropped
+			my_rt_mutex_lock(&piDev_g.lockListCon);
+			swap(priv->stage, st);
+			priv->stagePending = false;
+			rt_mutex_unlock(&piDev_g.lockListCon);
+			kfree(st);
+			status = 0;
+		}
+		break;
+
+	case KB_COMMIT_OUTPUTS:
+		{
+			struct revpi_stage *st;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			my_rt_mutex_lock(&piDev_g.lockListCon);
+			st = priv->stage;
+			if (!st) {
+				rt_mutex_unlock(&piDev_g.lockListCon);
+				return -EINVAL;
+			}
+
+			revpi_copy_marked(st->commit, st->data, st->dirty);
+			bitmap_or(st->pending, st->pending, st->dirty, KB_PI_LEN);
+			bitmap_zero(st->dirty, KB_PI_LEN);
+			if (!bitmap_empty(st->pending, KB_PI_LEN)) {
+				priv->stagePending = true;
+				piDev_g.stagePending = true;
+			}
+			rt_mutex_unlock(&piDev_g.lockListCon);
+			status = 0;
+		}
+		break;
+
+	case KB_CLAIM_OUTPUTS:
+		{
+			struct pictl_claim_list list;
+			struct pictl_claim *claim;
+			struct revpi_safe_state *safe = NULL;
+			unsigned long *claimed = NULL;
+			int i;
+
+			if (copy_from_user(&list, (const void __user *) usr_addr,
+					   sizeof(list))) {
+				pr_err("failed to copy claim list from user\n");
+				return -EFAULT;
+			}
+
+			if (list.count > KB_PI_LEN)
+				return -EINVAL;
+
+			if (list.count) {
+				claim = memdup_user((const void __user *) list.claim,
+						    list.count * sizeof(*claim));
+				if (IS_ERR(claim)) {
+					pr_err("failed to copy claims from user\n");
+					return PTR_ERR(claim);
+				}
+
+				claimed = kcalloc(BITS_TO_LONGS(KB_PI_LEN), sizeof(long), GFP_KERNEL);
+				if (!claimed) {
+					kfree(claim);
+					return -ENOMEM;
+				}
+
+				for (i = 0; i < list.count; i++) {
+					if (claim[i].length == 0 ||
+					    claim[i].offset + claim[i].length > KB_PI_LEN) {
+						printUserMsg(priv, "invalid claim %d: offset %d length %d",
+							     i, claim[i].offset, claim[i].length);
+						kfree(claim);
+						kfree(claimed);
+						return -EINVAL;
+					}
+					bitmap_set(claimed, claim[i].offset, claim[i].length);
+				}
+				kfree(claim);
+
+				safe = revpi_safe_state_from_bitmap(claimed);
+				if (!safe) {
+					kfree(claimed);
+					return -ENOMEM;
+				}
+			}
+
+			my_rt_mutex_lock(&piDev_g.lockListCon);
+			status = 0;
+			if (claimed) {
+				struct list_head *pCon;
+
+				// the ranges must not be owned by another instance
+				list_for_each(pCon, &piDev_g.listCon) {
+					tpiControlInst *inst = list_entry(pCon, tpiControlInst, list);
+
+					if (inst != priv && inst->claimed &&
+					    bitmap_intersects(inst->claimed, claimed, KB_PI_LEN)) {
+						status = -EBUSY;
+						break;
+					}
+				}
+			}
+
+			if (status == 0) {
+				u8 claimers = piDev_g.claimers;
+
+				if (priv->claimed)
+					claimers--;
+				if (claimed)
+					claimers++;
+				swap(priv->claimed, claimed);
+				swap(priv->claimSafe, safe);
+				piControlUpdateClaims();
+				// publish the bitmaps before the writers leave the fast path
+				smp_store_release(&piDev_g.claimers, claimers);
+			}
+			rt_mutex_unlock(&piDev_g.lockListCon);
+
+			kfree(claimed);
+			kfree(safe);
+		}
+		break;
+
+	case KB_GET_MODULE_STATS:
+		{
+			struct pictl_module_stats ms;
+			int i;
+
+			BUILD_BUG_ON(PICONTROL_STAT_BUCKETS != REVPI_STAT_BUCKETS);
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (copy_from_user(&ms, (const void __user *) usr_addr, sizeof(ms))) {
+				pr_err("failed to copy module address from user\n");
+				return -EFAULT;
+			}
+
+			status = -ENOENT;
+			for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+				SDeviceStats *stats = RevPiDevice_getStats(i);
+				u8 address = ms.address;
+
+				if (RevPiDevice_getDev(i)->i8uAddress != address)
+					continue;
+
+				memset(&ms, 0, sizeof(ms));
+				ms.address = address;
+				ms.count = stats->rtt.count;
+				if (ms.count) {
+					ms.rtt_min = stats->rtt.min;
+					ms.rtt_avg = div_u64(stats->rtt.sum, ms.count);
+					ms.rtt_max = stats->rtt.max;
+				}
+				memcpy(ms.rtt_hist, stats->rtt.hist, sizeof(ms.rtt_hist));
+				ms.crc_errors = stats->i32uCrcErrors;
+				ms.timeouts = stats->i32uTimeouts;
+				ms.send_errors = stats->i32uSendErrors;
+				ms.other_errors = stats->i32uOtherErrors;
+				status = 0;
+				break;
+			}
+
+			if (status == 0 && copy_to_user((void __user *) usr_addr, &ms, sizeof(ms))) {
+				pr_err("failed to copy module statistics to user\n");
+				return -EFAULT;
+			}
+		}
+		break;
+
+	case KB_SET_CYCLE_TIME:
+		{
+			struct pictl_cycle_time ct;
+
+			if (piDev_g.machine_type != REVPI_CORE && piDev_g.machine_type != REVPI_CONNECT)
+				return -EOPNOTSUPP;
+
+			// the bus timing affects all applications
+			if (!(file->f_mode & FMODE_WRITE) && !capable(CAP_SYS_ADMIN))
+				return -EPERM;
+
+			if (copy_from_user(&ct, (const void __user *) usr_addr, sizeof(ct))) {
+				pr_err("failed to copy cycle time from user\n");
+				return -EFAULT;
+			}
+
+			status = revpi_core_set_cycle(ct.cycle_us, ct.min_cycle_us);
+		}
+		break;
+
+	case KB_GET_CYCLE_TIME:
+		{
+			struct pictl_cycle_time ct;
+
+			if (piDev_g.machine_type != REVPI_CORE && piDev_g.machine_type != REVPI_CONNECT)
+				return -EOPNOTSUPP;
+
+			ct.cycle_us = READ_ONCE(piCore_g.cycleTimeUs);
+			ct.min_cycle_us = READ_ONCE(piCore_g.minCycleTimeUs);
+
+			if (copy_to_user((void __user *) usr_addr, &ct, sizeof(ct))) {
+				pr_err("failed to copy cycle time to user\n");
+				return -EFAULT;
+			}
+			status = 0;
+		}
+		break;
+
+	case KB_SET_POLL_DIVISOR:
+		{
+			struct pictl_poll_divisor pd;
+
+			if (piDev_g.machine_type != REVPI_CORE && piDev_g.machine_type != REVPI_CONNECT)
+				return -EOPNOTSUPP;
+
+			if (!isRunning())
+				return -EFAULT;
+
+			if (copy_from_user(&pd, (const void __user *) usr_addr, sizeof(pd))) {
+				pr_err("failed to copy poll divisor from user\n");
+				return -EFAULT;
+			}
+
+			status = RevPiDevice_setPollDivisor(pd.address, pd.divisor);
+		}
+		break;
+
 	case KB_SET_OUTPUT_WATCHDOG:
 		{
-			if (get_user(priv->tTimeoutDurationMs,
-				     (unsigned long __user *) usr_addr)) {
+			unsigned long ms;
+
+			if (get_user(ms, (unsigned long __user *) usr_addr)) {
 				pr_err("failed to copy timeout from user\n");
 				return -EFAULT;
 			}
 
-			priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
+			WRITE_ONCE(priv->tTimeoutDurationMs, ms);
+			if (ms > 0) {
+				piControlWatchdogKick(priv);
+			} else {
+				hrtimer_cancel(&priv->watchdog);
+				WRITE_ONCE(priv->watchdogExpired, false);
+			}
 			status = 0;
 		}
 		break;
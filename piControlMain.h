@@ -44,8 +44,11 @@
 #include <linux/leds.h>
 #include <linux/semaphore.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/bitmap.h>
 #include <piConfig.h>
 #include <IoProtocol.h>
+#include "revpi_common.h"
 /******************************************************************************/
 /*********************************  Types  ************************************/
 /******************************************************************************/
@@ -67,9 +70,11 @@ typedef struct spiControlDev {
 	struct cdev cdev;	// Char device structure
 	struct device *dev;
 	struct thermal_zone_device *thermal_zone;
+	struct dentry *debugfs;	// statistics
 
 	// process image stuff
-	INT8U ai8uPI[KB_PI_LEN];
+	INT8U *ai8uPI;		// one page, can be mmap()ed by user space
+	struct pictl_status *status;	// one page, mapped read-only
 	INT8U ai8uPIDefault[KB_PI_LEN];
 	struct rt_mutex lockPI;
 	bool stopIO;
@@ -77,8 +82,19 @@ typedef struct spiControlDev {
 	piEntries *ent;
 	piCopylist *cl;
 	piConnectionList *connl;
+	struct revpi_safe_state *safeOutputs;	// protected by lockPI
+	struct revpi_safe_state *safeExported;	// protected by lockPI
 	ktime_t tLastOutput1, tLastOutput2;
 
+	// woken up after each I/O cycle
+	wait_queue_head_t wqCycle;
+	INT8U *ai8uPISnap;	// snapshot for change detection
+	u8 watchers;		// number of instances with watches
+	bool stagePending;	// an instance has committed staged outputs
+	u8 claimers;		// number of instances owning ranges
+	struct kthread_worker *watchdogWorker;	// sets the outputs of expired watchdogs
+	DECLARE_BITMAP(claimed, KB_PI_LEN);	// bytes owned by any instance
+
 	// handle open connections and notification
 	u8 PnAppCon;		// counter of open connections
 	struct list_head listCon;
@@ -98,6 +114,14 @@ typedef struct spiControlDev {
 	struct led_trigger a5_red;
 } tpiControlDev;
 
+// outputs staged by write() until KB_COMMIT_OUTPUTS, see KB_STAGE_OUTPUTS
+struct revpi_stage {
+	u8 data[KB_PI_LEN];	// written by write()
+	u8 commit[KB_PI_LEN];	// committed, applied at the next cycle
+	DECLARE_BITMAP(dirty, KB_PI_LEN);	// bytes in data
+	DECLARE_BITMAP(pending, KB_PI_LEN);	// bytes in commit
+};
+
 typedef struct spiEventEntry {
 	enum piEvent event;
 	struct list_head list;
@@ -110,13 +134,98 @@ typedef struct spiControlInst {
 	struct list_head piEventList;	// head of the event list for this instance
 	struct rt_mutex lockEventList;
 	struct list_head list;	// list of all instances
-	ktime_t tTimeoutTS;	// time stamp when the output must be set to 0
+	struct hrtimer watchdog;	// expires if the outputs are not written in time
+	struct kthread_work watchdogWork;	// sets the outputs to their default values
+	bool watchdogExpired;		// cleared if the outputs are written before the work runs
 	unsigned long tTimeoutDurationMs;	// length of the timeout in ms, 0 if not active
+	u32 cycle;		// I/O cycle seen by the last read
+
+	// input change subscriptions, protected by lockListCon
+	struct pictl_watch *watch;
+	u32 watchCnt;
+	u8 *watchData;		// watched bytes as seen in the last cycle
+	u8 *watchChanged;	// per watch: changed since the last KB_WAIT_FOR_CHANGE
+	bool watchPending;
+
+	// output staging, protected by lockListCon
+	struct revpi_stage *stage;
+	bool stagePending;	// committed outputs wait for the next cycle
+
+	// owned ranges, protected by lockListCon
+	unsigned long *claimed;	// bitmap of the owned bytes, NULL if nothing is claimed
+	struct revpi_safe_state *claimSafe;	// default values of the owned bytes
 	char pcErrorMessage[REV_PI_ERROR_MSG_LEN];	// error message of last ioctl call
 } tpiControlInst;
 
 extern tpiControlDev piDev_g;
 
+/*
+ * Writers of the process image bracket their update with these instead of
+ * locking lockPI directly. The sequence counter in the status page lets
+ * lock-less readers, e.g. through mmap(), detect a torn snapshot and retry.
+ */
+static inline void revpi_image_write_lock(void)
+{
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	WRITE_ONCE(piDev_g.status->seq, piDev_g.status->seq + 1);
+	smp_wmb();
+}
+
+static inline void revpi_image_write_unlock(void)
+{
+	smp_wmb();
+	WRITE_ONCE(piDev_g.status->seq, piDev_g.status->seq + 1);
+	rt_mutex_unlock(&piDev_g.lockPI);
+}
+
+/*
+ * Lock-less readers of the process image. If a writer is active, the reader
+ * blocks on lockPI instead of spinning, so that a preempted low priority
+ * writer is boosted rather than starved. Writers should keep the section
+ * between revpi_image_write_lock() and revpi_image_write_unlock() short and
+ * not access user memory there, as readers wait for them.
+ */
+static inline u32 revpi_image_read_begin(void)
+{
+	u32 seq;
+
+	while ((seq = READ_ONCE(piDev_g.status->seq)) & 1) {
+		my_rt_mutex_lock(&piDev_g.lockPI);
+		rt_mutex_unlock(&piDev_g.lockPI);
+	}
+	smp_rmb();
+
+	return seq;
+}
+
+static inline bool revpi_image_read_retry(u32 seq)
+{
+	smp_rmb();
+	return READ_ONCE(piDev_g.status->seq) != seq;
+}
+
+static inline void revpi_image_read(void *dst, const void *src, size_t len)
+{
+	u32 seq;
+
+	do {
+		seq = revpi_image_read_begin();
+		memcpy(dst, src, len);
+	} while (revpi_image_read_retry(seq));
+}
+
+// copy the bytes marked in map from src to dst
+static inline void revpi_copy_marked(u8 *dst, const u8 *src, const unsigned long *map)
+{
+	unsigned int start = 0, end;
+
+	while ((start = find_next_bit(map, KB_PI_LEN, start)) < KB_PI_LEN) {
+		end = find_next_zero_bit(map, KB_PI_LEN, start);
+		memcpy(dst + start, src + start, end - start);
+		start = end;
+	}
+}
+
 /******************************************************************************/
 /*******************************  Prototypes  *********************************/
 /******************************************************************************/
@@ -179,9 +179,7 @@ INT32U piDIOComm_sendCyclicTelegram(INT8U i8uDevice_p)
 	i8uAddress = RevPiDevice_getDev(i8uDevice_p)->i8uAddress;
 
 	if (piDev_g.stopIO == false) {
-		rt_mutex_lock(&piDev_g.lockPI);
-		memcpy(data_out, piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uOutputOffset, len_l);
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_read(data_out, piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uOutputOffset, len_l);
 	} else {
 		memset(data_out, 0, len_l);
 	}
@@ -253,10 +251,10 @@ INT32U piDIOComm_sendCyclicTelegram(INT8U i8uDevice_p)
 					}
 				}
 
-				rt_mutex_lock(&piDev_g.lockPI);
+				revpi_image_write_lock();
 				memcpy(piDev_g.ai8uPI + RevPiDevice_getDev(i8uDevice_p)->i16uInputOffset, data_in,
 				       sizeof(data_in));
-				rt_mutex_unlock(&piDev_g.lockPI);
+				revpi_image_write_unlock();
 
 #ifdef DEBUG_DEVICE_DIO
 				if (last_in[i8uAddress][0] != sResponse_l.ai8uData[0]
@@ -42,6 +42,12 @@
 #include <linux/kthread.h>
 #include <linux/gpio.h>
 #include <linux/jiffies.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/of.h>
+#include <linux/serdev.h>
+#include <linux/tty.h>
+#include <linux/delay.h>
 
 #include <project.h>
 #include <common_define.h>
@@ -52,95 +58,114 @@
 #include "piIOComm.h"
 
 struct file *piIoComm_fd_m;
+struct serdev_device *piIoComm_serdev_m;
 int piIoComm_timeoutCnt_m;
 
-//static struct task_struct *hRecvThread_s;
-static INT8U recvBuffer[REV_PI_RECV_BUFFER_SIZE];
-static INT16U i16uHead_s, i16uTail_s;
-static INT16U i16uRecvLen_s;
-static struct semaphore recvLenSem;
-static struct semaphore queueSem;
+static char *tty = REV_PI_TTY_DEVICE;
+module_param(tty, charp, 0444);
+MODULE_PARM_DESC(tty, "tty of the PiBridge if it is not bound via serdev");
 
-// read one byte from the receive queue
-static int recv(INT8U * data)
-{
-	if (i16uHead_s == i16uTail_s) {
-		// queue is empty
-		return 0;
-	}
+static bool serdev;
+module_param(serdev, bool, 0444);
+MODULE_PARM_DESC(serdev, "use the serdev device of the PiBridge if there is one, "
+		 "receives in a SCHED_NORMAL kworker (default: false)");
+
+//-------------------------------------------------------------------------------------------------
+// Receive ring: the UART thread or the serdev callback is the only producer,
+// the thread calling piIoComm_recv_timeout() the only consumer. The indices
+// run freely and are masked on access. The producer publishes the data with a
+// release store of the head, the consumer frees it with a release store of
+// the tail. A consumer waiting for data sets recvWant to the head index it
+// needs; the producer wakes up recvWq when the head reaches it.
+//-------------------------------------------------------------------------------------------------
+static INT8U recvBuffer[REV_PI_RECV_RING_SIZE];
+static unsigned int recvHead;	// written by the producer only
+static unsigned int recvTail;	// written by the consumer only
+static unsigned int recvWant;	// 0 or head index + 1 the consumer waits for
+static DECLARE_WAIT_QUEUE_HEAD(recvWq);
 
-	*data = recvBuffer[i16uTail_s];
-	if (i16uTail_s >= REV_PI_RECV_BUFFER_SIZE - 1)
-		i16uTail_s = 0;
-	else
-		i16uTail_s++;
+// receive timeout of piIoComm_recv() in us, see piIoComm_setRecvTimeout()
+static unsigned int recvTimeoutUs = REV_PI_IO_TIMEOUT * USEC_PER_MSEC;
 
-	return 1;
+// number of bytes the consumer can read
+static unsigned int recv_avail(void)
+{
+	return smp_load_acquire(&recvHead) - recvTail;
 }
 
-static int enqueue(INT8U data)
+// copy len bytes from the receive ring, the caller checked recv_avail()
+static void recv(INT8U *data, unsigned int len)
 {
-	INT16U i16uNextHead;
-	if (i16uHead_s >= REV_PI_RECV_BUFFER_SIZE - 1) {
-		i16uNextHead = 0;
-	} else {
-		i16uNextHead = i16uHead_s + 1;
-	}
-	if (i16uNextHead == i16uTail_s) {
-		// full
-		return 0;
-	}
-	recvBuffer[i16uHead_s] = data;
-	i16uHead_s = i16uNextHead;
-	return 1;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = recvBuffer[(recvTail + i) & (REV_PI_RECV_RING_SIZE - 1)];
+	smp_store_release(&recvTail, recvTail + len);
 }
 
+// drop all received data, called by the consumer
 static void clear(void)
 {
 	pr_info_serial2("clear recv buffer\n");
 
-	i16uHead_s = i16uTail_s;
-	i16uRecvLen_s = 0;
+	smp_store_release(&recvTail, smp_load_acquire(&recvHead));
+}
+
+// wait until len bytes are available or the deadline has passed
+static bool recv_wait(unsigned int len, ktime_t deadline)
+{
+	ktime_t remaining;
+
+	if (recv_avail() >= len)
+		return true;
+
+	// the +1 keeps 0 free for "nobody waits"
+	WRITE_ONCE(recvWant, recvTail + len + 1);
+	smp_mb();
+
+	// wait with an hrtimer, the adaptive timeouts are often shorter than a jiffy
+	remaining = ktime_sub(deadline, ktime_get());
+	if (ktime_to_ns(remaining) > 0)
+		wait_event_hrtimeout(recvWq, recv_avail() >= len, remaining);
+
+	WRITE_ONCE(recvWant, 0);
+	return recv_avail() >= len;
+}
+
+// Process a chunk of received bytes, called by the producer
+static void receive(const INT8U *data, int len)
+{
+	unsigned int head = recvHead;
+	unsigned int want;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (head - smp_load_acquire(&recvTail) >= REV_PI_RECV_RING_SIZE)
+			break;	// full, drop the rest
+		recvBuffer[head & (REV_PI_RECV_RING_SIZE - 1)] = data[i];
+		head++;
+	}
+	smp_store_release(&recvHead, head);
+
+	smp_mb();
+	want = READ_ONCE(recvWant);
+	if (want && (int)(head - (want - 1)) >= 0 && cmpxchg(&recvWant, want, 0) == want)
+		wake_up(&recvWq);
 }
 
 int UartThreadProc(void *pArg)
 {
-#define MAX_READ_BUF 1
-	char acBuf_l[MAX_READ_BUF];
-	UIoProtocolHeader ioHeader_l;
+#define MAX_READ_BUF REV_PI_RECV_BUFFER_SIZE
+	INT8U acBuf_l[MAX_READ_BUF];
 
 	while (!kthread_should_stop()) {
-		//TODO optimize
+		// the tty is opened with VMIN 1 and VTIME 0, the read returns
+		// as soon as one byte is available with all bytes received so far
 		int r = kernel_read(piIoComm_fd_m, acBuf_l, MAX_READ_BUF, &piIoComm_fd_m->f_pos);
-		if (r != MAX_READ_BUF) {	// not finished yet
-			clear();
+		if (r <= 0)
 			return -1;
-		} else {
-			down(&recvLenSem);
-			if (i16uRecvLen_s > 0) {
-				enqueue(acBuf_l[0]);
-				i16uRecvLen_s--;
-				if (i16uRecvLen_s < REV_PI_RECV_IO_HEADER_LEN && i16uRecvLen_s >= REV_PI_RECV_IO_HEADER_LEN - IOPROTOCOL_HEADER_LENGTH) {
-					// if piIoComm_recv was called with the length value REV_PI_RECV_IO_HEADER_LEN,
-					// the length in the received header is used.
-					int l = REV_PI_RECV_IO_HEADER_LEN - i16uRecvLen_s;
-					ioHeader_l.ai8uHeader[l - 1] = acBuf_l[0];
-					pr_info("UartThread: %d %02x\n", l, acBuf_l[0]);
-					if (l == IOPROTOCOL_HEADER_LENGTH) {
-						// now we have received two bytes and can read length field
-						// we already received the header, set the length to the length of data plus crc byte
-						i16uRecvLen_s = ioHeader_l.sHeaderTyp1.bitLength + 1;
-						pr_info("UartThread: len=%d\n", i16uRecvLen_s);
-					}
-				}
-				if (i16uRecvLen_s == 0) {
-					up(&queueSem);
-				}
-			} else {
-				enqueue(acBuf_l[0]);
-			}
-			up(&recvLenSem);
-		}
+
+		receive(acBuf_l, r);
 	}
 
 	pr_info("UART Thread Exit\n");
@@ -162,7 +187,7 @@ int piIoComm_open_serial(void)
 	struct termios newtio;	/* Schnittstellenoptionen */
 
 	/* Port oeffnen - read/write, kein "controlling tty", Status von DCD ignorieren */
-	fd = filp_open(REV_PI_TTY_DEVICE, O_RDWR | O_NOCTTY, 0);
+	fd = filp_open(tty, O_RDWR | O_NOCTTY, 0);
 	if (!IS_ERR_OR_NULL(fd)) {
 		int r;
 		mm_segment_t oldfs;
@@ -190,6 +215,9 @@ int piIoComm_open_serial(void)
 		newtio.c_cflag = CLOCAL | CREAD;
 		newtio.c_cflag |= CS8 | PARENB | B115200;
 #endif
+		// blocking reads return all received bytes, but at least one
+		newtio.c_cc[VMIN] = 1;
+		newtio.c_cc[VTIME] = 0;
 		if (fd->f_op->unlocked_ioctl(fd, TCSETS, (unsigned long)&newtio) < 0) {
 			set_fs(oldfs);
 			pr_info("unlocked_ioctl TCSETS failed\n");
@@ -197,20 +225,143 @@ int piIoComm_open_serial(void)
 		}
 		set_fs(oldfs);
 	} else {
-		pr_err("could not open device %s", REV_PI_TTY_DEVICE);
+		pr_err("could not open device %s", tty);
 		return -1;
 	}
 	piIoComm_fd_m = fd;
 
 	pr_info_serial("filp_open %d\n", (int)piIoComm_fd_m);
 
-	sema_init(&queueSem, 0);
-	sema_init(&recvLenSem, 1);
-	clear();
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// serdev backend: if the module parameter serdev is set and the device tree
+// binds the UART of the PiBridge to this driver, the received data is passed
+// directly from the tty layer to receive() and the UART thread is not needed.
+// The tty layer calls receive_buf from its flip buffer work, an unbound
+// SCHED_NORMAL kworker. Under real-time load the responses are delayed and
+// may run into the receive timeout, therefore the file backend with its
+// SCHED_FIFO thread stays the default. See
+// Documentation/devicetree/bindings/kunbus,pibridge.txt
+//-------------------------------------------------------------------------------------------------
+#if IS_ENABLED(CONFIG_SERIAL_DEV_BUS)
+static int piIoComm_serdev_receive(struct serdev_device *sdev, const unsigned char *data, size_t count)
+{
+	receive(data, count);
+	return count;
+}
+
+static const struct serdev_device_ops piIoComm_serdev_ops = {
+	.receive_buf = piIoComm_serdev_receive,
+	.write_wakeup = serdev_device_write_wakeup,
+};
+
+static int piIoComm_serdev_probe(struct serdev_device *sdev)
+{
+	int ret;
+
+	if (piIoComm_serdev_m)
+		return -EBUSY;
 
+	serdev_device_set_client_ops(sdev, &piIoComm_serdev_ops);
+	ret = serdev_device_open(sdev);
+	if (ret) {
+		dev_err(&sdev->dev, "cannot open serdev device: %d\n", ret);
+		return ret;
+	}
+
+	serdev_device_set_baudrate(sdev, REV_PI_BAUDRATE);
+	serdev_device_set_flow_control(sdev, false);
+	ret = serdev_device_set_parity(sdev, SERDEV_PARITY_EVEN);
+	if (ret) {
+		dev_err(&sdev->dev, "cannot set parity: %d\n", ret);
+		serdev_device_close(sdev);
+		return ret;
+	}
+
+	piIoComm_serdev_m = sdev;
+	dev_info(&sdev->dev, "PiBridge bound via serdev\n");
 	return 0;
 }
 
+static void piIoComm_serdev_remove(struct serdev_device *sdev)
+{
+	serdev_device_close(sdev);
+	piIoComm_serdev_m = NULL;
+}
+
+static const struct of_device_id piIoComm_serdev_of_match[] = {
+	{ .compatible = "kunbus,pibridge" },
+	{ }
+};
+
+static struct serdev_device_driver piIoComm_serdev_driver = {
+	.probe = piIoComm_serdev_probe,
+	.remove = piIoComm_serdev_remove,
+	.driver = {
+		.name = "piControl-pibridge",
+		.of_match_table = piIoComm_serdev_of_match,
+		.suppress_bind_attrs = true,	// the PiBridge must not go away while piControl runs
+	},
+};
+
+static bool piIoComm_serdev_registered;
+
+static void piIoComm_serdev_register(void)
+{
+	if (!serdev)
+		return;
+
+	// the probe runs synchronously if the device exists
+	if (serdev_device_driver_register(&piIoComm_serdev_driver)) {
+		pr_err("cannot register serdev driver, use %s\n", tty);
+		return;
+	}
+	piIoComm_serdev_registered = true;
+}
+
+static void piIoComm_serdev_unregister(void)
+{
+	if (!piIoComm_serdev_registered)
+		return;
+
+	serdev_device_driver_unregister(&piIoComm_serdev_driver);
+	piIoComm_serdev_registered = false;
+}
+#else
+static void piIoComm_serdev_register(void)
+{
+}
+
+static void piIoComm_serdev_unregister(void)
+{
+}
+#endif
+
+// time a telegram of len bytes needs on the wire in us
+unsigned int piIoComm_onWireUs(INT16U len)
+{
+	return DIV_ROUND_UP((u32)len * REV_PI_BITS_PER_BYTE * 1000, REV_PI_BAUDRATE / 1000);
+}
+
+// Timeout for the transmitter to drain after a telegram of len bytes was
+// written: twice the time the telegram needs on the wire plus one jiffy.
+static unsigned long piIoComm_drainTimeout(INT16U len)
+{
+	return usecs_to_jiffies(2 * piIoComm_onWireUs(len)) + 1;
+}
+
+// Wait until a telegram of len bytes is on the wire. The serial core polls
+// the transmitter in steps of at least one jiffy, which would cost up to
+// 10 ms per telegram, so sleep for the computed time with an hrtimer.
+static void piIoComm_waitOnWire(INT16U len)
+{
+	unsigned int us = piIoComm_onWireUs(len);
+
+	usleep_range(us, us + REV_PI_DRAIN_SLACK_US);
+}
+
 int piIoComm_send(INT8U * buf_p, INT16U i16uLen_p)
 {
 	ssize_t write_l = 0;
@@ -241,6 +392,20 @@ int piIoComm_send(INT8U * buf_p, INT16U i16uLen_p)
 	//pr_info("vfs_write(%d, %d, %d)\n", (int)piIoComm_fd_m, i16uLen_p, (int)piIoComm_fd_m->f_pos);
 #endif
 
+#if IS_ENABLED(CONFIG_SERIAL_DEV_BUS)
+	if (piIoComm_serdev_m) {
+		write_l = serdev_device_write(piIoComm_serdev_m, buf_p, i16uLen_p,
+					      piIoComm_drainTimeout(i16uLen_p));
+		if (write_l != i16uLen_p) {
+			pr_info_serial("write error %d\n", (int)write_l);
+			return -1;
+		}
+		clear();
+		piIoComm_waitOnWire(i16uLen_p);
+		return 0;
+	}
+#endif
+
 	while (i16uSent_l < i16uLen_p) {
 		write_l = kernel_write(piIoComm_fd_m, buf_p + i16uSent_l, i16uLen_p - i16uSent_l, &piIoComm_fd_m->f_pos);
 		if (write_l < 0) {
@@ -255,53 +420,52 @@ int piIoComm_send(INT8U * buf_p, INT16U i16uLen_p)
 			return -2;
 		}
 	}
-	down(&recvLenSem);
 	clear();
-	up(&recvLenSem);
-	vfs_fsync(piIoComm_fd_m, 1);
+	piIoComm_waitOnWire(i16uLen_p);
+	// only if the uart is behind, fall back to polling its transmitter
+	if (tty_chars_in_buffer(file_tty(piIoComm_fd_m)))
+		tty_wait_until_sent(file_tty(piIoComm_fd_m), piIoComm_drainTimeout(i16uLen_p));
 	return 0;
 }
 
+// Set the timeout of piIoComm_recv() in us, 0 restores REV_PI_IO_TIMEOUT.
+void piIoComm_setRecvTimeout(unsigned int us)
+{
+	recvTimeoutUs = us ? us : REV_PI_IO_TIMEOUT * USEC_PER_MSEC;
+}
+
 int piIoComm_recv(INT8U * buf_p, INT16U i16uLen_p)
 {
-	return piIoComm_recv_timeout(buf_p, i16uLen_p, REV_PI_IO_TIMEOUT);
+	return piIoComm_recv_timeout_us(buf_p, i16uLen_p, recvTimeoutUs);
 }
 
 int piIoComm_recv_timeout(INT8U * buf_p, INT16U i16uLen_p, INT16U timeout_p)
 {
-	INT16U i;
-	down(&recvLenSem);
-	if (i16uRecvLen_s > 0) {
-		pr_err("recv: last recv is not finished\n");
-		clear();
-	}
+	return piIoComm_recv_timeout_us(buf_p, i16uLen_p, timeout_p * USEC_PER_MSEC);
+}
 
-	i = 0;
-	while (i < i16uLen_p && recv(&buf_p[i])) {
-		i++;
-	}
+int piIoComm_recv_timeout_us(INT8U * buf_p, INT16U i16uLen_p, unsigned int timeout_us)
+{
+	ktime_t deadline = ktime_add_us(ktime_get(), timeout_us);
+	INT16U i16uLen_l = i16uLen_p;
+	INT16U i = 0;
 
-	if (i == i16uLen_p) {
-		// alle Daten wurden schon empfangen
-		up(&recvLenSem);
-	} else {
-		i16uRecvLen_s = i16uLen_p - i;
-		up(&recvLenSem);
-
-		if (down_timeout(&queueSem, msecs_to_jiffies(timeout_p)) != 0) {
-			// timeout
-			pr_info_io("recv timeout: %d/%d \n", i16uRecvLen_s, i16uLen_p);
-			down(&recvLenSem);
-			clear();
-			up(&recvLenSem);
-			return 0;
-		}
-		down(&recvLenSem);
-		for (; i < i16uLen_p; i++)
-			recv(&buf_p[i]);
-		up(&recvLenSem);
+	if (i16uLen_p == REV_PI_RECV_IO_HEADER_LEN) {
+		// receive an IoProtocol telegram, the length is taken from the header
+		UIoProtocolHeader *hdr = (UIoProtocolHeader *) buf_p;
+
+		if (!recv_wait(IOPROTOCOL_HEADER_LENGTH, deadline))
+			goto timeout;
+		recv(buf_p, IOPROTOCOL_HEADER_LENGTH);
+		i = IOPROTOCOL_HEADER_LENGTH;
+		// length of data plus crc byte
+		i16uLen_l = IOPROTOCOL_HEADER_LENGTH + hdr->sHeaderTyp1.bitLength + 1;
 	}
 
+	if (!recv_wait(i16uLen_l - i, deadline))
+		goto timeout;
+	recv(buf_p + i, i16uLen_l - i);
+
 #ifdef DEBUG_SERIALCOMM
 	if (i16uLen_p == 1) {
 		pr_info("recv %d: %02x\n", i16uLen_p, buf_p[0]);
@@ -326,6 +490,11 @@ int piIoComm_recv_timeout(INT8U * buf_p, INT16U i16uLen_p, INT16U timeout_p)
 	}
 #endif
 	return i16uLen_p;
+
+timeout:
+	pr_info_io("recv timeout: %d/%d \n", recv_avail(), i16uLen_l);
+	clear();
+	return 0;
 }
 
 INT8U piIoComm_Crc8(INT8U * pi8uFrame_p, INT16U i16uLen_p)
@@ -402,11 +571,19 @@ err:
 
 int piIoComm_init(void)
 {
+	clear();
+
+	piIoComm_serdev_register();
+	if (piIoComm_serdev_m)
+		return 0;
+
 	return piIoComm_open_serial();
 }
 
 void piIoComm_finish(void)
 {
+	piIoComm_serdev_unregister();
+
 	if (piIoComm_fd_m != NULL) {
 		pr_info_serial("filp_close %d\n", (int)piIoComm_fd_m);
 		filp_close(piIoComm_fd_m, NULL);
@@ -753,7 +930,7 @@ int revpi_io_talk(void *sndbuf, int sndlen, void *rcvbuf, int rcvlen)
 	if(ret != rcvlen) {
 		pr_err_ratelimited("recv len from pibridge err(got:%d, exp:%d)",
 								ret, rcvlen);
-		return -ECOMM;
+		return -ETIMEDOUT;
 	}
 
 	return 0;
@@ -39,10 +39,14 @@
 
 #define REV_PI_IO_TIMEOUT           10         // msec
 #define REV_PI_RECV_BUFFER_SIZE     100
+#define REV_PI_RECV_RING_SIZE       512        // must be a power of 2
 
 #define REV_PI_RECV_IO_HEADER_LEN	65530
 
 #define REV_PI_TTY_DEVICE	"/dev/ttyAMA0"
+#define REV_PI_BAUDRATE		115200
+#define REV_PI_BITS_PER_BYTE	11		// start bit, 8 data bits, even parity, stop bit
+#define REV_PI_DRAIN_SLACK_US	50		// allowed lateness of the wait for a sent telegram
 
 enum IOSTATE {
     /* physically not connected */
@@ -63,13 +67,17 @@ typedef enum _EGpioMode
     enGpioMode_Output,
 } EGpioMode;
 
-extern struct file *piIoComm_fd_m;
+extern struct file *piIoComm_fd_m;		// file backend, read by the UART thread
+extern struct serdev_device *piIoComm_serdev_m;	// serdev backend, NULL if not bound
 extern int piIoComm_timeoutCnt_m;
 
 int piIoComm_open_serial(void);
 int piIoComm_send(INT8U *buf_p, INT16U i16uLen_p);
-int piIoComm_recv(INT8U *buf_p, INT16U i16uLen_p);	// using default timeout REV_PI_IO_TIMEOUT
+int piIoComm_recv(INT8U *buf_p, INT16U i16uLen_p);	// using the timeout set by piIoComm_setRecvTimeout()
 int piIoComm_recv_timeout(INT8U * buf_p, INT16U i16uLen_p, INT16U timeout_p);
+int piIoComm_recv_timeout_us(INT8U *buf_p, INT16U i16uLen_p, unsigned int timeout_us);
+void piIoComm_setRecvTimeout(unsigned int us);
+unsigned int piIoComm_onWireUs(INT16U len);
 bool piIoComm_response_valid(SIOGeneric *resp, u8 expected_addr,
 			     u8 expected_len);
 int UartThreadProc ( void *pArg);
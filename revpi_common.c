@@ -12,6 +12,8 @@
 #include <linux/leds.h>
 #include <linux/sched.h>
 #include <soc/bcm2835/raspberrypi-firmware.h>
+#include <linux/sort.h>
+#include <asm/unaligned.h>
 
 #include "revpi_common.h"
 #include "common_define.h"
@@ -113,38 +115,355 @@ void revpi_power_led_red_set(enum revpi_power_led_mode mode)
 }
 
 
-void revpi_check_timeout(void)
+static int cmp_safe_range(const void *a, const void *b)
 {
-	ktime_t now = ktime_get();
+	const struct revpi_safe_range *ra = a, *rb = b;
+
+	return (int)ra->offset - (int)rb->offset;
+}
+
+// sort the ranges and merge adjacent bytes and bits of the same byte
+static unsigned int revpi_safe_state_merge(struct revpi_safe_range *r, unsigned int n)
+{
+	unsigned int i, d;
+
+	if (n == 0)
+		return 0;
+
+	sort(r, n, sizeof(*r), cmp_safe_range, NULL);
+
+	for (i = 0, d = 1; d < n; d++) {
+		if (r[i].mask == 0xff && r[d].mask == 0xff
+		    && r[d].offset <= r[i].offset + r[i].length) {
+			r[i].length = max_t(u16, r[i].length, r[d].offset + r[d].length - r[i].offset);
+		} else if (r[i].mask != 0xff && r[d].mask != 0xff
+			   && r[d].offset == r[i].offset) {
+			r[i].mask |= r[d].mask;
+		} else {
+			r[++i] = r[d];
+		}
+	}
+	return i + 1;
+}
+
+/**
+ * revpi_safe_state_build() - precompute the safe state of the outputs
+ *
+ * Must be called whenever the configuration or the list of active modules
+ * changes. Collects the output ranges of all active modules and of the
+ * exported outputs, so that revpi_set_safe_state() only has to copy merged
+ * ranges from ai8uPIDefault.
+ */
+void revpi_safe_state_build(void)
+{
+	struct revpi_safe_state *outputs, *exported;
+	piCopylist *cl = piDev_g.cl;
+	unsigned int n, cnt;
+	int i;
+
+	cnt = RevPiDevice_getDevCnt();
+	outputs = kmalloc(sizeof(*outputs) + cnt * sizeof(struct revpi_safe_range), GFP_KERNEL);
+	if (outputs) {
+		for (i = 0, n = 0; i < cnt; i++) {
+			SDevice *dev = RevPiDevice_getDev(i);
+
+			if (!dev->i8uActive || dev->sId.i16uFBS_OutputLength == 0
+			    || dev->i16uOutputOffset + dev->sId.i16uFBS_OutputLength > KB_PI_LEN)
+				continue;
+
+			outputs->range[n].offset = dev->i16uOutputOffset;
+			outputs->range[n].length = dev->sId.i16uFBS_OutputLength;
+			outputs->range[n].mask = 0xff;
+			n++;
+		}
+		outputs->count = revpi_safe_state_merge(outputs->range, n);
+	}
+
+	cnt = cl ? cl->i16uNumEntries : 0;
+	exported = kmalloc(sizeof(*exported) + cnt * sizeof(struct revpi_safe_range), GFP_KERNEL);
+	if (exported) {
+		for (i = 0; i < cnt; i++) {
+			if (cl->ent[i].i16uLength >= 8) {
+				exported->range[i].length = cl->ent[i].i16uLength / 8;
+				exported->range[i].mask = 0xff;
+			} else {
+				exported->range[i].length = 1;
+				exported->range[i].mask = cl->ent[i].i8uBitMask;
+			}
+			exported->range[i].offset = cl->ent[i].i16uAddr;
+		}
+		exported->count = revpi_safe_state_merge(exported->range, cnt);
+	}
+
+	revpi_image_write_lock();
+	swap(piDev_g.safeOutputs, outputs);
+	swap(piDev_g.safeExported, exported);
+	revpi_image_write_unlock();
+
+	kfree(outputs);
+	kfree(exported);
+}
+
+// lockPI must be held for writing
+static void revpi_safe_state_apply(const struct revpi_safe_state *st)
+{
+	const INT8U *def = piDev_g.ai8uPIDefault;
+	INT8U *pi = piDev_g.ai8uPI;
+	unsigned int i;
+
+	for (i = 0; st && i < st->count; i++) {
+		const struct revpi_safe_range *r = &st->range[i];
+
+		if (r->mask == 0xff)
+			memcpy(pi + r->offset, def + r->offset, r->length);
+		else
+			pi[r->offset] = (pi[r->offset] & ~r->mask) | (def[r->offset] & r->mask);
+	}
+}
+
+// like revpi_safe_state_apply(), but leaves the bytes set in skip unchanged
+static void revpi_safe_state_apply_except(const struct revpi_safe_state *st,
+					  const unsigned long *skip)
+{
+	const INT8U *def = piDev_g.ai8uPIDefault;
+	INT8U *pi = piDev_g.ai8uPI;
+	unsigned int i, start, end, stop;
+
+	for (i = 0; st && i < st->count; i++) {
+		const struct revpi_safe_range *r = &st->range[i];
+
+		stop = r->offset + r->length;
+		for (start = find_next_zero_bit(skip, stop, r->offset); start < stop;
+		     start = find_next_zero_bit(skip, stop, end)) {
+			end = find_next_bit(skip, stop, start);
+			if (r->mask == 0xff)
+				memcpy(pi + start, def + start, end - start);
+			else
+				pi[start] = (pi[start] & ~r->mask) | (def[start] & r->mask);
+		}
+	}
+}
+
+/**
+ * revpi_set_safe_state() - set outputs to their default values
+ * @scope: all outputs or only the exported ones
+ *
+ * Used by the output watchdog, on close of a handle with an active watchdog
+ * and if logiRTS stops writing its outputs.
+ */
+void revpi_set_safe_state(enum revpi_safe_scope scope)
+{
+	revpi_image_write_lock();
+	if (scope == REVPI_SAFE_EXPORTED)
+		revpi_safe_state_apply(piDev_g.safeExported);
+	else
+		revpi_safe_state_apply(piDev_g.safeOutputs);
+	revpi_image_write_unlock();
+}
+
+// set the bytes of a range list to their default values
+void revpi_set_safe_ranges(const struct revpi_safe_state *st)
+{
+	revpi_image_write_lock();
+	revpi_safe_state_apply(st);
+	revpi_image_write_unlock();
+}
+
+// set the outputs of a handle to their default values, lockListCon must be held.
+// A handle without claims owns all outputs not claimed by another handle.
+void revpi_set_inst_safe_state(tpiControlInst *inst)
+{
+	if (inst->claimed) {
+		revpi_set_safe_ranges(inst->claimSafe);
+	} else if (piDev_g.claimers) {
+		revpi_image_write_lock();
+		revpi_safe_state_apply_except(piDev_g.safeOutputs, piDev_g.claimed);
+		revpi_image_write_unlock();
+	} else {
+		revpi_set_safe_state(REVPI_SAFE_OUTPUTS);
+	}
+}
+
+/**
+ * revpi_safe_state_from_bitmap() - build a range list from a bitmap
+ * @map: one bit per byte of the process image
+ *
+ * Return: a list of the contiguous ranges of set bits, to be freed with
+ * kfree(), or NULL if out of memory.
+ */
+struct revpi_safe_state *revpi_safe_state_from_bitmap(const unsigned long *map)
+{
+	struct revpi_safe_state *st;
+	unsigned int start, end, n = 0;
+
+	for (start = find_first_bit(map, KB_PI_LEN); start < KB_PI_LEN;
+	     start = find_next_bit(map, KB_PI_LEN, end)) {
+		end = find_next_zero_bit(map, KB_PI_LEN, start);
+		n++;
+	}
+
+	st = kmalloc(sizeof(*st) + n * sizeof(struct revpi_safe_range), GFP_KERNEL);
+	if (!st)
+		return NULL;
+
+	st->count = 0;
+	for (start = find_first_bit(map, KB_PI_LEN); start < KB_PI_LEN;
+	     start = find_next_bit(map, KB_PI_LEN, end)) {
+		end = find_next_zero_bit(map, KB_PI_LEN, start);
+		st->range[st->count].offset = start;
+		st->range[st->count].length = end - start;
+		st->range[st->count].mask = 0xff;
+		st->count++;
+	}
+	return st;
+}
+
+static void revpi_check_watches(void)
+{
+	INT8U *image = piDev_g.ai8uPISnap;
 	struct list_head *pCon;
 
+	if (!READ_ONCE(piDev_g.watchers))
+		return;
+
+	revpi_image_read(image, piDev_g.ai8uPI, KB_PI_LEN);
+
 	my_rt_mutex_lock(&piDev_g.lockListCon);
 	list_for_each(pCon, &piDev_g.listCon) {
-		tpiControlInst *pos_inst;
-		pos_inst = list_entry(pCon, tpiControlInst, list);
-
-		if (pos_inst->tTimeoutDurationMs != 0) {
-			if (ktime_compare(now, pos_inst->tTimeoutTS) > 0) {
-				// set all outputs to 0
-				int i;
-				my_rt_mutex_lock(&piDev_g.lockPI);
-				for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
-					if (RevPiDevice_getDev(i)->i8uActive) {
-						memset(piDev_g.ai8uPI + RevPiDevice_getDev(i)->i16uOutputOffset, 0, RevPiDevice_getDev(i)->sId.i16uFBS_OutputLength);
+		tpiControlInst *inst;
+		bool changed = false;
+		u8 *prev;
+		int i, j;
+
+		inst = list_entry(pCon, tpiControlInst, list);
+		prev = inst->watchData;
+
+		for (i = 0; i < inst->watchCnt; i++) {
+			struct pictl_watch *w = &inst->watch[i];
+			u8 *cur = image + w->offset;
+
+			if (w->mask == 0 || w->mask == 0xff) {
+				if (memcmp(prev, cur, w->length)) {
+					memcpy(prev, cur, w->length);
+					inst->watchChanged[i] = 1;
+					changed = true;
+				}
+			} else {
+				for (j = 0; j < w->length; j++) {
+					if ((prev[j] ^ cur[j]) & w->mask) {
+						inst->watchChanged[i] = 1;
+						changed = true;
 					}
+					prev[j] = cur[j];
 				}
-				rt_mutex_unlock(&piDev_g.lockPI);
-				pos_inst->tTimeoutTS = ktime_add_ms(ktime_get(), pos_inst->tTimeoutDurationMs);
-
-				// this must only be done for one connection
-				rt_mutex_unlock(&piDev_g.lockListCon);
-				return;
 			}
+			prev += w->length;
+		}
+
+		if (changed) {
+			inst->watchPending = true;
+			wake_up_interruptible(&inst->wq);
 		}
 	}
 	rt_mutex_unlock(&piDev_g.lockListCon);
 }
 
+/**
+ * revpi_cycle_begin() - start an I/O cycle
+ *
+ * Called by the I/O thread before the outputs of a cycle are taken from the
+ * process image. Publishes the outputs committed with KB_COMMIT_OUTPUTS.
+ */
+void revpi_cycle_begin(void)
+{
+	struct list_head *pCon;
+
+	if (!READ_ONCE(piDev_g.stagePending))
+		return;
+
+	my_rt_mutex_lock(&piDev_g.lockListCon);
+	if (piDev_g.stagePending) {
+		revpi_image_write_lock();
+		list_for_each(pCon, &piDev_g.listCon) {
+			tpiControlInst *inst = list_entry(pCon, tpiControlInst, list);
+			struct revpi_stage *st = inst->stage;
+
+			if (!st || !inst->stagePending)
+				continue;
+
+			// ranges may have been claimed since KB_STAGE_OUTPUTS
+			if (inst->claimed)
+				bitmap_and(st->pending, st->pending, inst->claimed, KB_PI_LEN);
+			else if (piDev_g.claimers)
+				bitmap_andnot(st->pending, st->pending, piDev_g.claimed, KB_PI_LEN);
+			revpi_copy_marked(piDev_g.ai8uPI, st->commit, st->pending);
+			bitmap_zero(st->pending, KB_PI_LEN);
+			inst->stagePending = false;
+		}
+		piDev_g.stagePending = false;
+		revpi_image_write_unlock();
+	}
+	rt_mutex_unlock(&piDev_g.lockListCon);
+}
+
+/*
+ * Copy the connected variables configured in piCtory, so that the outputs
+ * follow their inputs in the next cycle without a user space process.
+ */
+static void revpi_run_connections(void)
+{
+	INT8U *pi = piDev_g.ai8uPI;
+	piConnectionList *connl;
+	int i;
+
+	if (!READ_ONCE(piDev_g.connl))
+		return;
+
+	revpi_image_write_lock();
+	// piControlReset replaces the list under lockPI
+	connl = piDev_g.connl;
+	for (i = 0; connl && i < connl->i16uNumEntries; i++) {
+		const piConnection *c = &connl->conn[i];
+		INT8U *src = pi + c->i16uSrcAddr;
+		INT8U *dst = pi + c->i16uDestAddr;
+
+		switch (c->i8uLength) {
+		case 0:
+			// invalid connection
+			break;
+		case 8:
+			*dst = *src;
+			break;
+		case 16:
+			put_unaligned(get_unaligned((u16 *)src), (u16 *)dst);
+			break;
+		case 32:
+			put_unaligned(get_unaligned((u32 *)src), (u32 *)dst);
+			break;
+		default:
+			*dst = (*dst & ~(c->i8uMask << c->i8uDestBit))
+			     | (((*src >> c->i8uSrcBit) & c->i8uMask) << c->i8uDestBit);
+			break;
+		}
+	}
+	revpi_image_write_unlock();
+}
+
+/**
+ * revpi_cycle_complete() - signal the end of an I/O cycle
+ *
+ * Called by the I/O thread once the inputs of a cycle have been written to
+ * the process image. Applies the piCtory connections, wakes up all instances
+ * waiting in poll() and those whose watched ranges have changed.
+ */
+void revpi_cycle_complete(void)
+{
+	revpi_run_connections();
+	smp_store_release(&piDev_g.status->cycle, piDev_g.status->cycle + 1);
+	wake_up_interruptible_all(&piDev_g.wqCycle);
+	revpi_check_watches();
+}
+
 void revpi_power_led_red_run(void)
 {
 	switch (power_led_mode_s) {
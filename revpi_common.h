@@ -1,3 +1,6 @@
+#ifndef _REVPI_COMMON_H
+#define _REVPI_COMMON_H
+
 #include <linux/sched.h>
 #include <linux/version.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
@@ -5,6 +8,27 @@
 #include <uapi/linux/sched/types.h>
 #endif
 
+/*
+ * One range of the safe state of the outputs, the values are taken from
+ * ai8uPIDefault. If mask is not 0xff, length is 1 and only the bits set in
+ * mask are changed.
+ */
+struct revpi_safe_range {
+	u16 offset;
+	u16 length;
+	u8 mask;
+};
+
+struct revpi_safe_state {
+	unsigned int count;
+	struct revpi_safe_range range[0];
+};
+
+enum revpi_safe_scope {
+	REVPI_SAFE_OUTPUTS,	// outputs of all active modules
+	REVPI_SAFE_EXPORTED,	// outputs exported to logiRTS
+};
+
 enum revpi_power_led_mode {
 	REVPI_POWER_LED_OFF = 0,
 	REVPI_POWER_LED_ON = 1,
@@ -17,7 +41,15 @@ void revpi_led_trigger_event(u16 led_prev, u16 led);
 void revpi_power_led_red_set(enum revpi_power_led_mode mode);
 void revpi_power_led_red_run(void);
 
-void revpi_check_timeout(void);
+void revpi_safe_state_build(void);
+void revpi_set_safe_state(enum revpi_safe_scope scope);
+void revpi_set_safe_ranges(const struct revpi_safe_state *st);
+struct spiControlInst;
+void revpi_set_inst_safe_state(struct spiControlInst *inst);
+struct revpi_safe_state *revpi_safe_state_from_bitmap(const unsigned long *map);
+
+void revpi_cycle_begin(void);
+void revpi_cycle_complete(void);
 
 int bcm2835_cpufreq_clock_property(u32 tag, u32 id, u32 * val);
 uint32_t bcm2835_cpufreq_get_clock(void);
@@ -48,3 +80,5 @@ struct kthread_prio {
 };
 
 int set_kthread_prios(const struct kthread_prio *ktprios);
+
+#endif /* _REVPI_COMMON_H */
@@ -159,8 +159,9 @@ static int revpi_compact_poll_io(void *data)
 			!!gpiod_get_value_cansleep(machine->dout_fault) << 5;
 
 		MEASSURE(2);
+		revpi_cycle_begin();
 		flip_process_image(image, machine->config.offset);
-		revpi_check_timeout();
+		revpi_cycle_complete();
 
 		MEASSURE(3);
 		/* write dout on every cycle to feed watchdog */
@@ -247,9 +248,9 @@ static int revpi_compact_poll_ain(void *data)
 				unsigned long config = machine->config.ain[i];
 
 				if (!test_bit(AIN_ENABLED, &config)) {
-					my_rt_mutex_lock(&piDev_g.lockPI);
+					revpi_image_write_lock();
 					image->drv.ain[i] = 0;
-					rt_mutex_unlock(&piDev_g.lockPI);
+					revpi_image_write_unlock();
 					continue;
 				}
 
@@ -287,14 +288,14 @@ static int revpi_compact_poll_ain(void *data)
 		/* poll ain */
 		ret = iio_read_channel_raw(&machine->ain[mux[i]], &raw);
 
-		my_rt_mutex_lock(&piDev_g.lockPI);
+		revpi_image_write_lock();
 		assign_bit_in_byte(AIN_TX_ERR, &image->drv.ain_status, ret < 0);
 		if (ret < 0) {
 			image->drv.ain[chan[i]] = 0;
-			rt_mutex_unlock(&piDev_g.lockPI);
+			revpi_image_write_unlock();
 			goto next_chan;
 		}
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
 
 		/* raw value in mV = ((raw * 12.5V) >> 21 bit) + 6.25V */
 		tmp = shift_right((s64)raw * 12500 * 100000000LL, 21);
@@ -311,16 +312,16 @@ static int revpi_compact_poll_ain(void *data)
 			GetPt100Temperature(resistance, &raw);
 		}
 
-		my_rt_mutex_lock(&piDev_g.lockPI);
+		revpi_image_write_lock();
 		image->drv.ain[chan[i]] = raw;
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
 
 next_chan:
 		if (++i >= numchans) {
 			i = 0;
 
 			// update every 1 sec
-			my_rt_mutex_lock(&piDev_g.lockPI);
+			revpi_image_write_lock();
 			if (piDev_g.thermal_zone != NULL) {
 				int temp, ret;
 
@@ -333,7 +334,7 @@ next_chan:
 			}
 
 			image->drv.i8uCPUFrequency = bcm2835_cpufreq_get_clock() / 10;
-			rt_mutex_unlock(&piDev_g.lockPI);
+			revpi_image_write_unlock();
 		}
 
 		cycletimer_sleep(&ct);
@@ -724,11 +725,15 @@ int revpi_compact_reset()
 	int ret;
 
 	/* disallow access to process image while offsets are changed */
-	my_rt_mutex_lock(&piDev_g.lockPI);
+	revpi_image_write_lock();
 	revpi_compact_adjust_config();
 	memset(&image->usr, 0, sizeof(image->usr));
 	revpi_set_defaults(piDev_g.ai8uPI, piDev_g.ent);
-	rt_mutex_unlock(&piDev_g.lockPI);
+	memset(piDev_g.ai8uPIDefault, 0, KB_PI_LEN);
+	revpi_set_defaults(piDev_g.ai8uPIDefault, piDev_g.ent);
+	revpi_image_write_unlock();
+
+	revpi_safe_state_build();
 
 	machine->config = revpi_compact_config_g;
 
@@ -32,6 +32,7 @@
 #include <linux/of.h>
 #include <linux/gpio/consumer.h>
 #include <linux/gpio/machine.h>
+#include <linux/debugfs.h>
 #include <asm/div64.h>
 
 #include "common_define.h"
@@ -41,6 +42,17 @@
 #include "revpi_core.h"
 #include "compat.h"
 
+#define REVPI_CORE_CYCLE_MIN_US		500
+#define REVPI_CORE_CYCLE_MAX_US		(1000*1000)
+
+static unsigned int cycle_us;
+module_param(cycle_us, uint, 0444);
+MODULE_PARM_DESC(cycle_us, "period of the I/O cycles in us, 0 runs the cycles back-to-back (default)");
+
+static unsigned int min_cycle_us;
+module_param(min_cycle_us, uint, 0444);
+MODULE_PARM_DESC(min_cycle_us, "minimum period of back-to-back I/O cycles in us");
+
 static const struct kthread_prio revpi_core_kthread_prios[] = {
 	/* spi pump to RevPi Gateways */
 	{ .comm = "spi0",		.prio = MAX_USER_RT_PRIO/2 + 4 },
@@ -152,12 +164,27 @@ static enum hrtimer_restart piIoTimer(struct hrtimer *pTimer)
 	return HRTIMER_NORESTART;
 }
 
+static void piIoThread_resetStats(void)
+{
+	int i;
+
+	revpi_stat_reset(&piCore_g.statCycle);
+	revpi_stat_reset(&piCore_g.statLatency);
+	for (i = 0; i < ARRAY_SIZE(piCore_g.statRun); i++)
+		revpi_stat_reset(&piCore_g.statRun[i]);
+	piCore_g.statLate = 0;
+	RevPiDevice_resetStats();
+}
+
 static int piIoThread(void *data)
 {
 	//TODO int value = 0;
 	ktime_t time;
 	ktime_t now;
+	ktime_t start;
 	s64 tDiff;
+	u32 cycle;
+	enPiBridgeState state;
 
 	hrtimer_init(&piCore_g.ioTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
 	piCore_g.ioTimer.function = piIoTimer;
@@ -167,68 +194,75 @@ static int piIoThread(void *data)
 	now = hrtimer_cb_get_time(&piCore_g.ioTimer);
 
 	PiBridgeMaster_Reset();
+	piIoThread_resetStats();
 
 	while (!kthread_should_stop()) {
+		if (READ_ONCE(piCore_g.statReset)) {
+			piIoThread_resetStats();
+			WRITE_ONCE(piCore_g.statReset, false);
+		}
+
+		start = ktime_get();
+		state = piCore_g.eBridgeState;
+
+		if (piCore_g.eBridgeState == piBridgeRun)
+			revpi_cycle_begin();
+
 		if (PiBridgeMaster_Run() < 0)
 			break;
 
+		if (piCore_g.eBridgeState == piBridgeRun)
+			revpi_cycle_complete();
+
 		time = now;
 		now = hrtimer_cb_get_time(&piCore_g.ioTimer);
 
 		time = ktime_sub(now, time);
 		piCore_g.image.drv.i8uIOCycle = ktime_to_ms(time);
 
+		if (state < ARRAY_SIZE(piCore_g.statRun))
+			revpi_stat_add(&piCore_g.statRun[state], ktime_us_delta(now, start));
+		if (state == piBridgeRun)
+			revpi_stat_add(&piCore_g.statCycle, ktime_to_us(time));
+
 		if (!ktime_equal(piDev_g.tLastOutput1, piDev_g.tLastOutput2)) {
 			tDiff = ktime_to_ns(ktime_sub(piDev_g.tLastOutput1, piDev_g.tLastOutput2));
 			tDiff = tDiff << 1;	// multiply by 2
 			if (ktime_to_ns(ktime_sub(now, piDev_g.tLastOutput1)) > tDiff && isRunning()) {
-				int i;
 				// the outputs were not written by logiCAD for more than twice the normal period
 				// the logiRTS must have been stopped or crashed
-				// -> set all outputs to 0
-				pr_info("logiRTS timeout, set all output to 0\n");
-				if (piDev_g.stopIO == false) {
-					my_rt_mutex_lock(&piDev_g.lockPI);
-					for (i = 0; i < piDev_g.cl->i16uNumEntries; i++) {
-						uint16_t len = piDev_g.cl->ent[i].i16uLength;
-						uint16_t addr = piDev_g.cl->ent[i].i16uAddr;
-
-						if (len >= 8) {
-							len /= 8;
-							memset(piDev_g.ai8uPI + addr, 0, len);
-						} else {
-							uint8_t val;
-							uint8_t mask = piDev_g.cl->ent[i].i8uBitMask;
-
-							val = piDev_g.ai8uPI[addr];
-							val &= ~mask;
-							piDev_g.ai8uPI[addr] = val;
-						}
-					}
-					rt_mutex_unlock(&piDev_g.lockPI);
-				}
+				// -> set the exported outputs to their default values
+				pr_info("logiRTS timeout, set all output to default\n");
+				if (piDev_g.stopIO == false)
+					revpi_set_safe_state(REVPI_SAFE_EXPORTED);
 				piDev_g.tLastOutput1 = ktime_set(0, 0);
 				piDev_g.tLastOutput2 = ktime_set(0, 0);
 			}
 		}
 
-		revpi_check_timeout();
-
-		if (piCore_g.eBridgeState == piBridgeInit) {
-			time = ktime_add_ns(time, INTERVAL_RS485);
-		} else {
-			time = ktime_add_ns(time, INTERVAL_IO_COMM);
-		}
+		// the deadline of the next cycle is relative to the start of this one
+		cycle = READ_ONCE(piCore_g.cycleTimeUs);
+		if (piCore_g.eBridgeState == piBridgeInit)
+			time = ktime_add_ns(start, INTERVAL_RS485);
+		else if (cycle)
+			time = ktime_add_us(start, cycle);
+		else
+			time = ktime_add_us(start, READ_ONCE(piCore_g.minCycleTimeUs));
 
 		if (ktime_after(now, time)) {
-			// the call of PiBridgeMaster_Run() needed more time than the INTERVAL
-			// -> wait an additional ms
-			//pr_info("%d ms too late, state %d\n", (int)((now.tv64 - time.tv64) >> 20), piCore_g.eBridgeState);
+			// the call of PiBridgeMaster_Run() needed more time than the cycle,
+			// or the cycles run back-to-back
+			// -> wait an additional 0.5 ms
 			time = ktime_add_ns(now, INTERVAL_ADDITIONAL);
+			if (state == piBridgeRun && cycle)
+				piCore_g.statLate++;
 		}
 
 		hrtimer_start(&piCore_g.ioTimer, time, HRTIMER_MODE_ABS);
 		down(&piCore_g.ioSem);	// wait for timer
+
+		if (state == piBridgeRun)
+			revpi_stat_add(&piCore_g.statLatency, max_t(s64, ktime_us_delta(ktime_get(), time), 0));
 	}
 
 	RevPiDevice_finish();
@@ -237,6 +271,101 @@ static int piIoThread(void *data)
 	return 0;
 }
 
+static int revpi_core_cycle_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "late cycles: %u\n", piCore_g.statLate);
+	revpi_stat_show(m, "cycle", &piCore_g.statCycle);
+	revpi_stat_show(m, "timer latency", &piCore_g.statLatency);
+	revpi_stat_show(m, "run (stopped)", &piCore_g.statRun[piBridgeStop]);
+	revpi_stat_show(m, "run (init)", &piCore_g.statRun[piBridgeInit]);
+	revpi_stat_show(m, "run (running)", &piCore_g.statRun[piBridgeRun]);
+	return 0;
+}
+
+static int revpi_core_cycle_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, revpi_core_cycle_show, NULL);
+}
+
+static int revpi_core_modules_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		SDevice *dev = RevPiDevice_getDev(i);
+		SDeviceStats *stats = RevPiDevice_getStats(i);
+		SDeviceTiming *timing = RevPiDevice_getTiming(i);
+		char name[32];
+
+		if (stats->rtt.count == 0 && stats->i32uCrcErrors == 0 && stats->i32uTimeouts == 0
+		    && stats->i32uSendErrors == 0 && stats->i32uOtherErrors == 0)
+			continue;
+
+		seq_printf(m, "module %d type %d: crc errors %u  timeouts %u  send errors %u  other errors %u\n",
+			   dev->i8uAddress, dev->sId.i16uModulType, stats->i32uCrcErrors,
+			   stats->i32uTimeouts, stats->i32uSendErrors, stats->i32uOtherErrors);
+		seq_printf(m, "module %d timing: srtt %u us  rttvar %u us  receive timeout %u us  consecutive timeouts %u\n",
+			   dev->i8uAddress, timing->i32uSrtt, timing->i32uRttVar,
+			   timing->i32uRto ? timing->i32uRto : REV_PI_IO_TIMEOUT * USEC_PER_MSEC,
+			   timing->i8uTimeouts);
+		snprintf(name, sizeof(name), "module %d round trip", dev->i8uAddress);
+		revpi_stat_show(m, name, &stats->rtt);
+	}
+	return 0;
+}
+
+static int revpi_core_modules_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, revpi_core_modules_show, NULL);
+}
+
+// any write resets the statistics
+static ssize_t revpi_core_cycle_write(struct file *file, const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	WRITE_ONCE(piCore_g.statReset, true);
+	return count;
+}
+
+static const struct file_operations revpi_core_cycle_fops = {
+	.owner = THIS_MODULE,
+	.open = revpi_core_cycle_open,
+	.read = seq_read,
+	.write = revpi_core_cycle_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations revpi_core_modules_fops = {
+	.owner = THIS_MODULE,
+	.open = revpi_core_modules_open,
+	.read = seq_read,
+	.write = revpi_core_cycle_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * revpi_core_set_cycle() - set the scheduling of the piIO thread
+ * @period_us: period of the cycles in us, 0 runs the cycles back-to-back
+ * @min_period_us: minimum period of the cycles if @period_us is 0
+ *
+ * The new values take effect at the end of the current cycle.
+ *
+ * Return: 0 on success or -EINVAL if a value is out of range.
+ */
+int revpi_core_set_cycle(u32 period_us, u32 min_period_us)
+{
+	if (period_us && (period_us < REVPI_CORE_CYCLE_MIN_US || period_us > REVPI_CORE_CYCLE_MAX_US))
+		return -EINVAL;
+	if (min_period_us > REVPI_CORE_CYCLE_MAX_US)
+		return -EINVAL;
+
+	WRITE_ONCE(piCore_g.cycleTimeUs, period_us);
+	WRITE_ONCE(piCore_g.minCycleTimeUs, min_period_us);
+	return 0;
+}
+
 int revpi_core_init(void)
 {
 	struct sched_param param;
@@ -245,6 +374,11 @@ int revpi_core_init(void)
 	piCore_g.i8uLeftMGateIdx = REV_PI_DEV_UNDEF;
 	piCore_g.i8uRightMGateIdx = REV_PI_DEV_UNDEF;
 
+	if (revpi_core_set_cycle(cycle_us, min_cycle_us)) {
+		pr_err("invalid cycle time %u us / %u us\n", cycle_us, min_cycle_us);
+		return -EINVAL;
+	}
+
 	if (piDev_g.machine_type == REVPI_CORE) {
 		// the Core has two modular gateway ports
 		gpiod_add_lookup_table(&revpi_core_gpios);
@@ -322,17 +456,21 @@ int revpi_core_init(void)
 	if (ret)
 		goto err_close_serial;
 
-	piCore_g.pUartThread = kthread_run(&UartThreadProc, (void *)NULL, "piControl Uart");
-	if (IS_ERR(piCore_g.pUartThread)) {
-		pr_err("kthread_run(uart) failed\n");
-		ret = PTR_ERR(piCore_g.pUartThread);
-		goto err_close_serial;
-	}
-	param.sched_priority = RT_PRIO_UART;
-	sched_setscheduler(piCore_g.pUartThread, SCHED_FIFO, &param);
-	if (ret) {
-		pr_err("cannot set rt prio of uart thread\n");
-		goto err_stop_uart_thread;
+	// the serdev backend receives in the context of the tty layer
+	piCore_g.pUartThread = NULL;
+	if (piIoComm_fd_m) {
+		piCore_g.pUartThread = kthread_run(&UartThreadProc, (void *)NULL, "piControl Uart");
+		if (IS_ERR(piCore_g.pUartThread)) {
+			pr_err("kthread_run(uart) failed\n");
+			ret = PTR_ERR(piCore_g.pUartThread);
+			goto err_close_serial;
+		}
+		param.sched_priority = RT_PRIO_UART;
+		sched_setscheduler(piCore_g.pUartThread, SCHED_FIFO, &param);
+		if (ret) {
+			pr_err("cannot set rt prio of uart thread\n");
+			goto err_stop_uart_thread;
+		}
 	}
 
 	piCore_g.pIoThread = kthread_run(&piIoThread, NULL, "piControl I/O");
@@ -348,12 +486,16 @@ int revpi_core_init(void)
 		goto err_stop_io_thread;
 	}
 
+	debugfs_create_file("cycle", 0644, piDev_g.debugfs, NULL, &revpi_core_cycle_fops);
+	debugfs_create_file("modules", 0644, piDev_g.debugfs, NULL, &revpi_core_modules_fops);
+
 	return ret;
 
 err_stop_io_thread:
 	kthread_stop(piCore_g.pIoThread);
 err_stop_uart_thread:
-	kthread_stop(piCore_g.pUartThread);
+	if (piCore_g.pUartThread)
+		kthread_stop(piCore_g.pUartThread);
 err_close_serial:
 	piIoComm_finish();
 err_gpiod_put:
@@ -387,7 +529,8 @@ void revpi_core_fini(void)
 {
 	// the IoThread cannot be stopped
 	kthread_stop(piCore_g.pIoThread);
-	kthread_stop(piCore_g.pUartThread);
+	if (piCore_g.pUartThread)
+		kthread_stop(piCore_g.pUartThread);
 	piIoComm_finish();
 
 	/* reset GPIO direction */
@@ -23,6 +23,7 @@
 #include "piControlMain.h"
 #include "piControl.h"
 #include "piIOComm.h"
+#include "revpi_stats.h"
 
 
 typedef enum {
@@ -97,6 +98,17 @@ typedef struct _SRevPiCore {
 	struct task_struct *pIoThread;
 	struct hrtimer ioTimer;
 	struct semaphore ioSem;
+
+	// cycle statistics of the piIO thread, see debugfs piControl/cycle and modules
+	struct revpi_stat statCycle;	// time between the start of two cycles
+	struct revpi_stat statLatency;	// wakeup latency of ioTimer
+	struct revpi_stat statRun[piBridgeRun + 1];	// execution time per bridge state
+	u32 statLate;			// cycles which needed more than the cycle time
+	bool statReset;			// set by debugfs, done by the piIO thread
+
+	// scheduling of the piIO thread, see revpi_core_set_cycle()
+	u32 cycleTimeUs;		// period of the cycles in us, 0 for adaptive mode
+	u32 minCycleTimeUs;		// minimum period of the cycles in adaptive mode
 } SRevPiCore;
 
 extern SRevPiCore piCore_g;
@@ -105,3 +117,4 @@ u8 revpi_core_find_gate(struct net_device *netdev, u16 module_type);
 void revpi_core_gate_connected(SDevice *revpi_dev, bool connected);
 int revpi_core_init(void);
 void revpi_core_fini(void);
+int revpi_core_set_cycle(u32 period_us, u32 min_period_us);
@@ -106,7 +106,8 @@ static int revpi_flat_poll_dout(void *data)
 
 	usr_image = (struct revpi_flat_image *) piDev_g.ai8uPI;
 	while (!kthread_should_stop()) {
-		my_rt_mutex_lock(&piDev_g.lockPI);
+		revpi_cycle_begin();
+		revpi_image_write_lock();
 		image->drv.button = gpiod_get_value_cansleep(flat->button_desc);
 		usr_image->drv = image->drv;
 
@@ -117,7 +118,8 @@ static int revpi_flat_poll_dout(void *data)
 			aout_val = usr_image->usr.aout;
 
 		image->usr = usr_image->usr;
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
+		revpi_cycle_complete();
 
 		if (dout_val != -1) {
 			gpiod_set_value_cansleep(flat->digout, !!dout_val);
@@ -173,9 +175,9 @@ static int revpi_flat_handle_ain(struct revpi_flat *flat, bool mode_current)
 
 	ain_val = (int) div_s64(ain_val, 1000000000LL);
 
-	my_rt_mutex_lock(&piDev_g.lockPI);
+	revpi_image_write_lock();
 	image->drv.ain = ain_val;
-	rt_mutex_unlock(&piDev_g.lockPI);
+	revpi_image_write_unlock();
 
 	return 0;
 }
@@ -195,7 +197,7 @@ static int revpi_flat_poll_ain(void *data)
 		if (ret)
 			msleep(REVPI_FLAT_AIN_POLL_INTERVAL);
 
-		my_rt_mutex_lock(&piDev_g.lockPI);
+		revpi_image_write_lock();
 		/* read cpu temperature */
 		if (piDev_g.thermal_zone != NULL) {
 			ret = thermal_zone_get_temp(piDev_g.thermal_zone,
@@ -211,7 +213,7 @@ static int revpi_flat_poll_ain(void *data)
 		image->drv.cpu_freq = bcm2835_cpufreq_get_clock() / 10;
 		leds = image->usr.leds;
 		ain_mode_current = !!image->usr.ain_mode_current;
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
 
 		if (prev_leds != leds)
 			revpi_led_trigger_event(prev_leds, leds);
@@ -279,10 +281,14 @@ static void revpi_flat_adjust_config(void)
 
 static void revpi_flat_set_defaults(void)
 {
-	my_rt_mutex_lock(&piDev_g.lockPI);
-	memset(piDev_g.ai8uPI, 0, sizeof(piDev_g.ai8uPI));
+	revpi_image_write_lock();
+	memset(piDev_g.ai8uPI, 0, KB_PI_LEN);
 	revpi_set_defaults(piDev_g.ai8uPI, piDev_g.ent);
-	rt_mutex_unlock(&piDev_g.lockPI);
+	memset(piDev_g.ai8uPIDefault, 0, KB_PI_LEN);
+	revpi_set_defaults(piDev_g.ai8uPIDefault, piDev_g.ent);
+	revpi_image_write_unlock();
+
+	revpi_safe_state_build();
 }
 
 int revpi_flat_reset()
@@ -129,9 +129,9 @@ static void revpi_gate_destroy_work(struct work_struct *work)
 
 	if (conn->revpi_dev && !piDev_g.stopIO) {
 		conn->revpi_dev->i8uModuleState = FBSTATE_LINK;
-		rt_mutex_lock(&piDev_g.lockPI);
+		revpi_image_write_lock();
 		memset(conn->in, 0, conn->in_len);
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
 	}
 
 	if (conn->nf_hook_ops.dev)
@@ -244,9 +244,7 @@ static void revpi_gate_send_work(struct work_struct *work)
 		return;
 
 	if (conn->revpi_dev && !piDev_g.stopIO) {
-		rt_mutex_lock(&piDev_g.lockPI);
-		memcpy(al->i8uData, conn->out, conn->out_len);
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_read(al->i8uData, conn->out, conn->out_len);
 	} else {
 		memset(al->i8uData, 0, conn->out_len);
 	}
@@ -316,12 +314,12 @@ static int revpi_gate_process_cyclicpd(struct sk_buff *rcv,
 
 	if (conn->revpi_dev && !piDev_g.stopIO) {
 		conn->revpi_dev->i8uModuleState = rcv_al->i8uFieldbusStatus;
-		rt_mutex_lock(&piDev_g.lockPI);
+		revpi_image_write_lock();
 		memcpy(conn->in + rcv_al->i16uOffset, rcv_al->i8uData,
 		       rcv_al->i16uDataLen);
 		if (skb)
 			memcpy(al->i8uData, conn->out, conn->out_len);
-		rt_mutex_unlock(&piDev_g.lockPI);
+		revpi_image_write_unlock();
 	} else {
 		if (skb)
 			memset(al->i8uData, 0, conn->out_len);
@@ -51,9 +51,7 @@ static int revpi_mio_cycle_dio(SDevice *dev, SMioDigitalRequestData *req_data,
 			      sizeof(SMioDigitalRequestData),
 			      IOP_TYP1_CMD_DATA);
 	/*copy: from process image:output to request*/
-	rt_mutex_lock(&piDev_g.lockPI);
-	memcpy(&req.sData, req_data, sizeof(SMioDigitalRequestData));
-	rt_mutex_unlock(&piDev_g.lockPI);
+	revpi_image_read(&req.sData, req_data, sizeof(SMioDigitalRequestData));
 
 	req.i8uCrc = revpi_crc8(&req, sizeof(req) - 1);
 
@@ -61,7 +59,7 @@ static int revpi_mio_cycle_dio(SDevice *dev, SMioDigitalRequestData *req_data,
 	if (ret) {
 		pr_err_ratelimited("talk with mio for dio data error(addr:%d, "
 				   "ret:%d)\n", dev->i8uAddress, ret);
-		return -EIO;
+		return ret;
 	}
 
 	crc_cal = revpi_crc8(&resp, sizeof(resp) - 1);
@@ -75,9 +73,9 @@ static int revpi_mio_cycle_dio(SDevice *dev, SMioDigitalRequestData *req_data,
 		     *(unsigned short *) &req.uHeader,
 		     *(unsigned short *) &resp.uHeader);
 	/*copy: from response to process image:input*/
-	rt_mutex_lock(&piDev_g.lockPI);
+	revpi_image_write_lock();
 	memcpy(resp_data, &resp.sData, sizeof(SMioDigitalResponseData));
-	rt_mutex_unlock(&piDev_g.lockPI);
+	revpi_image_write_unlock();
 
 	return 0;
 }
@@ -94,11 +92,9 @@ static int revpi_mio_cycle_aio(SDevice *dev, SMioAnalogRequestData *req_data,
 	revpi_io_build_header(&req.uHeader, dev->i8uAddress,
 			      sizeof(SMioAnalogRequestData) - compressed,
 			      IOP_TYP1_CMD_DATA2);
-	/*copy: from process image:output to request*/
-	rt_mutex_lock(&piDev_g.lockPI);
+	/*copy: from staged process image:output to request*/
 	memcpy(&req.sData, req_data, sizeof(SMioAnalogRequestData) -
 				     compressed);
-	rt_mutex_unlock(&piDev_g.lockPI);
 
 	req.i8uCrc = revpi_crc8(&req, sizeof(req) - 1 - compressed);
 	/*crc is adjoining data */
@@ -109,7 +105,7 @@ static int revpi_mio_cycle_aio(SDevice *dev, SMioAnalogRequestData *req_data,
 	if (ret) {
 		pr_err_ratelimited("talk with mio for aio data error(addr:%d, "
 				   "ret:%d)\n", dev->i8uAddress, ret);
-		return -EIO;
+		return ret;
 	}
 	crc_cal = revpi_crc8(&resp, sizeof(resp) - 1);
 
@@ -123,9 +119,9 @@ static int revpi_mio_cycle_aio(SDevice *dev, SMioAnalogRequestData *req_data,
 		     *(unsigned short *) &req.uHeader,
 		     *(unsigned short *) &resp.uHeader);
 	/*copy: from response to process image*/
-	rt_mutex_lock(&piDev_g.lockPI);
+	revpi_image_write_lock();
 	memcpy(resp_data, &resp.sData, sizeof(SMioAnalogResponseData));
-	rt_mutex_unlock(&piDev_g.lockPI);
+	revpi_image_write_unlock();
 
 	return 0;
 }
@@ -0,0 +1,62 @@
+/*
+ * revpi_stats.c - timing statistics with log-scale histograms
+ *
+ * Copyright (C) 2020 KUNBUS GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License (version 2) as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+#include "revpi_stats.h"
+
+void revpi_stat_reset(struct revpi_stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->min = U32_MAX;
+}
+
+/*
+ * The statistics are updated by one thread only. Readers may see a
+ * partially updated set of values, which is acceptable for diagnostics.
+ */
+void revpi_stat_add(struct revpi_stat *st, u32 us)
+{
+	st->count++;
+	st->sum += us;
+	if (us < st->min)
+		st->min = us;
+	if (us > st->max)
+		st->max = us;
+	st->hist[min_t(unsigned int, fls(us), REVPI_STAT_BUCKETS - 1)]++;
+}
+
+void revpi_stat_show(struct seq_file *m, const char *name, const struct revpi_stat *st)
+{
+	u32 count = st->count;
+	int i;
+
+	if (count == 0) {
+		seq_printf(m, "%s: no samples\n", name);
+		return;
+	}
+
+	seq_printf(m, "%s: count %u  min %u us  avg %llu us  max %u us\n",
+		   name, count, st->min, div_u64(st->sum, count), st->max);
+
+	for (i = 0; i < REVPI_STAT_BUCKETS; i++) {
+		if (st->hist[i] == 0)
+			continue;
+		if (i == 0)
+			seq_printf(m, "  %6u - %6u us: %u\n", 0, 0, st->hist[i]);
+		else if (i == REVPI_STAT_BUCKETS - 1)
+			seq_printf(m, "  %6u -    max us: %u\n", 1U << (i - 1), st->hist[i]);
+		else
+			seq_printf(m, "  %6u - %6u us: %u\n", 1U << (i - 1), (1U << i) - 1, st->hist[i]);
+	}
+}
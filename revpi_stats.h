@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2020 KUNBUS GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License (version 2) as
+ * published by the Free Software Foundation.
+ */
+#ifndef _REVPI_STATS_H_
+#define _REVPI_STATS_H_
+
+#include <linux/types.h>
+#include <linux/seq_file.h>
+
+// bucket 0 counts 0 us, bucket n counts 2^(n-1) to 2^n - 1 us, the last one all above
+#define REVPI_STAT_BUCKETS	16
+
+struct revpi_stat {
+	u32 count;
+	u32 min;		// us
+	u32 max;		// us
+	u64 sum;		// us
+	u32 hist[REVPI_STAT_BUCKETS];
+};
+
+void revpi_stat_reset(struct revpi_stat *st);
+void revpi_stat_add(struct revpi_stat *st, u32 us);
+void revpi_stat_show(struct seq_file *m, const char *name, const struct revpi_stat *st);
+
+#endif /* _REVPI_STATS_H_ */